@@ -26,6 +26,10 @@ DxScriptObjectBase::DxScriptObjectBase() {
 	priRender_ = 50;
 	
 	frameExist_ = 0;
+
+	for (CastCacheEntry& iEntry : cacheCast_)
+		iEntry = { nullptr, nullptr };
+	indexCastCache_ = 0;
 }
 DxScriptObjectBase::~DxScriptObjectBase() {
 	//if (manager_ != nullptr && idObject_ != DxScript::ID_INVALID)
@@ -2012,10 +2016,6 @@ std::vector<int> DxScriptObjectManager::GetValidObjectIdentifier() {
 	}
 	return res;
 }
-DxScriptObjectBase* DxScriptObjectManager::GetObjectPointer(int id) {
-	if (id < 0 || id >= obj_.size()) return nullptr;
-	return obj_[id].get();
-}
 
 void DxScriptObjectManager::_DeleteObject(int id) {
 	if (id < 0 || id >= obj_.size()) return;
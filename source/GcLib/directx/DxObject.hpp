@@ -37,6 +37,16 @@ namespace directx {
 
 		std::unordered_map<std::wstring, gstd::value> mapObjectValue_;
 		std::unordered_map<int64_t, gstd::value> mapObjectValueI_;
+
+		//Results of the last few casts done by GetPointerAs, keyed by target type
+		//	Kept in the object itself, so a reused object ID can never hit a stale entry
+		struct CastCacheEntry {
+			const std::type_info* type;
+			void* ptr;
+		};
+		enum : uint8_t { CAST_CACHE_SIZE = 4 };
+		CastCacheEntry cacheCast_[CAST_CACHE_SIZE];
+		uint8_t indexCastCache_;
 	public:
 		DxScriptObjectBase();
 		virtual ~DxScriptObjectBase();
@@ -71,6 +81,21 @@ namespace directx {
 
 		std::unordered_map<std::wstring, gstd::value>& GetValueMap() { return mapObjectValue_; }
 		std::unordered_map<int64_t, gstd::value>& GetValueMapI() { return mapObjectValueI_; }
+
+		//dynamic_cast, but remembers the result for this object (including failed casts)
+		//	Only the cast is saved, callers still look the object up by ID first
+		template<class T> T* GetPointerAs() {
+			const std::type_info* type = &typeid(T);
+			for (CastCacheEntry& iEntry : cacheCast_) {
+				if (iEntry.type == type)
+					return static_cast<T*>(iEntry.ptr);
+			}
+
+			T* res = dynamic_cast<T*>(this);
+			cacheCast_[indexCastCache_] = { type, res };
+			indexCastCache_ = (indexCastCache_ + 1) % CAST_CACHE_SIZE;
+			return res;
+		}
 	};
 
 	//****************************************************************************
@@ -933,7 +958,9 @@ namespace directx {
 
 		std::vector<int> GetValidObjectIdentifier();
 
-		DxScriptObjectBase* GetObjectPointer(int id);
+		DxScriptObjectBase* GetObjectPointer(int id) {
+			return ((id < 0 || id >= obj_.size()) ? nullptr : obj_[id].get());
+		}
 		virtual void DeleteObject(int id);
 		virtual void DeleteObject(ref_unsync_ptr<DxScriptObjectBase> obj);
 		virtual void DeleteObject(DxScriptObjectBase* obj);
@@ -66,7 +66,11 @@ namespace directx {
 
 		ref_unsync_ptr<DxScriptObjectBase> GetObject(int id) { return objManager_->GetObject(id); }
 		DxScriptObjectBase* GetObjectPointer(int id) { return objManager_->GetObjectPointer(id); }
-		template<class T> T* GetObjectPointerAs(int id) { return dynamic_cast<T*>(GetObjectPointer(id)); }
+		//The ID lookup is a bounds-checked index, only the cast after it is cached
+		template<class T> T* GetObjectPointerAs(int id) {
+			DxScriptObjectBase* obj = GetObjectPointer(id);
+			return obj ? obj->GetPointerAs<T>() : nullptr;
+		}
 
 		virtual void DeleteObject(int id) { objManager_->DeleteObject(id); }
 		void ClearObject() { objManager_->ClearObject(); }
@@ -5,10 +5,176 @@
 using namespace gstd;
 using namespace directx;
 
+//*******************************************************************
+//ScriptIsolationGate
+//*******************************************************************
+thread_local ScriptIsolationGate::Worker* ScriptIsolationGate::currentWorker_ = nullptr;
+ScriptIsolationGate::ScriptIsolationGate() {
+	bStop_ = false;
+	pListJob_ = nullptr;
+}
+ScriptIsolationGate::~ScriptIsolationGate() {
+	{
+		std::lock_guard<std::mutex> lock(mtx_);
+		bStop_ = true;
+	}
+	cvWorker_.notify_all();
+	for (auto& worker : listWorker_) {
+		if (worker->thread.joinable())
+			worker->thread.join();
+	}
+	listWorker_.clear();
+}
+void ScriptIsolationGate::_Run(Worker* worker) {
+	currentWorker_ = worker;
+
+	std::unique_lock<std::mutex> lock(mtx_);
+	while (true) {
+		cvWorker_.wait(lock, [&]() { return bStop_ || worker->state == WORKER_RUNNING; });
+		if (bStop_) break;
+		lock.unlock();
+
+		//Job i always goes to worker (i % MAX_WORKER)
+		const std::vector<Job>& listJob = *pListJob_;
+		for (size_t iJob = worker->index; iJob < listJob.size(); iJob += MAX_WORKER) {
+			try {
+				listJob[iJob]();
+			}
+			catch (...) {
+				listJobError_[iJob] = std::current_exception();
+			}
+		}
+
+		lock.lock();
+		worker->state = WORKER_DONE;
+		cvMain_.notify_one();
+	}
+
+	currentWorker_ = nullptr;
+}
+
+//Runs the jobs on the workers, natives parked by them are run on the calling thread in the meantime
+//	Rethrows the error of the first failed job once all of them are done
+void ScriptIsolationGate::Run(const std::vector<Job>& listJob) {
+	if (listJob.size() == 0) return;
+
+	size_t countWorker = std::min<size_t>(listJob.size(), MAX_WORKER);
+	while (listWorker_.size() < countWorker) {
+		Worker* worker = new Worker();
+		worker->index = listWorker_.size();
+		worker->state = WORKER_IDLE;
+		listWorker_.push_back(unique_ptr<Worker>(worker));
+		worker->thread = std::thread(&ScriptIsolationGate::_Run, this, worker);
+	}
+
+	std::unique_lock<std::mutex> lock(mtx_);
+	pListJob_ = &listJob;
+	listJobError_.assign(listJob.size(), nullptr);
+	for (size_t iWorker = 0; iWorker < countWorker; ++iWorker)
+		listWorker_[iWorker]->state = WORKER_RUNNING;
+	cvWorker_.notify_all();
+
+	std::vector<Worker*> listParked;
+	while (true) {
+		cvMain_.wait(lock, [&]() {
+			for (size_t iWorker = 0; iWorker < countWorker; ++iWorker) {
+				if (listWorker_[iWorker]->state == WORKER_RUNNING) return false;
+			}
+			return true;
+		});
+
+		listParked.clear();
+		for (size_t iWorker = 0; iWorker < countWorker; ++iWorker) {
+			if (listWorker_[iWorker]->state == WORKER_PARKED)
+				listParked.push_back(listWorker_[iWorker].get());
+		}
+		if (listParked.size() == 0) break;
+
+		//Every worker is waiting, nothing else touches script data until they are released
+		lock.unlock();
+		for (Worker* worker : listParked) {
+			try {
+				worker->result = _CallIsolated(worker->machine, worker->func, worker->argc, worker->argv);
+			}
+			catch (...) {
+				worker->error = std::current_exception();
+			}
+		}
+		lock.lock();
+
+		for (Worker* worker : listParked)
+			worker->state = WORKER_RUNNING;
+		cvWorker_.notify_all();
+	}
+
+	for (size_t iWorker = 0; iWorker < countWorker; ++iWorker)
+		listWorker_[iWorker]->state = WORKER_IDLE;
+	pListJob_ = nullptr;
+	lock.unlock();
+
+	for (std::exception_ptr& error : listJobError_) {
+		if (error) std::rethrow_exception(error);
+	}
+}
+
+gstd::value ScriptIsolationGate::call(script_machine* machine, dnh_func_callback_t func, int argc, const value* argv) {
+	if (ScriptClientBase::IsThreadSafeFunction(func))
+		return func(machine, argc, argv);
+
+	Worker* worker = currentWorker_;
+	if (worker == nullptr) {
+		//Main thread, e.g. an event requested by a parked call
+		return _CallIsolated(machine, func, argc, argv);
+	}
+
+	std::unique_lock<std::mutex> lock(mtx_);
+	worker->machine = machine;
+	worker->func = func;
+	worker->argc = argc;
+	worker->argv = argv;
+	worker->state = WORKER_PARKED;
+	cvMain_.notify_one();
+	cvWorker_.wait(lock, [&]() { return worker->state == WORKER_RUNNING; });
+
+	value res = worker->result;
+	worker->result = value();
+	if (worker->error) {
+		std::exception_ptr error = worker->error;
+		worker->error = nullptr;
+		std::rethrow_exception(error);
+	}
+	return res;
+}
+//Arrays are rebuilt on both ways, so that no payload is ever shared with data outside the script
+value ScriptIsolationGate::_CallIsolated(script_machine* machine, dnh_func_callback_t func, int argc, const value* argv) {
+	std::vector<value> listArg(argc);
+	for (int i = 0; i < argc; ++i)
+		listArg[i] = _Isolate(argv[i]);
+	return _Isolate(func(machine, argc, listArg.data()));
+}
+value ScriptIsolationGate::_Isolate(const value& v) {
+	type_data* type = v.get_type();
+	if (type == nullptr || type->get_kind() != type_data::tk_array)
+		return v;
+	if (const std::wstring* str = v.as_packed_string())
+		return value(type, *str);
+
+	size_t size = v.length_as_array();
+	std::vector<value> arr(size);
+	for (size_t i = 0; i < size; ++i)
+		arr[i] = _Isolate(v.get_element_as_array(i));
+
+	value res;
+	res.reset(type, arr);
+	return res;
+}
+
 //*******************************************************************
 //ScriptManager
 //*******************************************************************
 std::atomic<int64_t> ScriptManager::idScript_ = 0;
+uint64_t ScriptManager::defaultInstructionBudget_ = 0;
+bool ScriptManager::bDefaultInstructionBudgetYield_ = false;
 ScriptManager::ScriptManager() {
 	mainThreadID_ = GetCurrentThreadId();
 
@@ -33,31 +199,49 @@ void ScriptManager::Work(int targetType) {
 	LARGE_INTEGER startTime, endTime;
 	LARGE_INTEGER timeFreq;
 	QueryPerformanceFrequency(&timeFreq);
+
+	bool bIsolatedRun = false;
 	
 	for (auto itr = listScriptRun_.begin(); itr != listScriptRun_.end(); ) {
 		shared_ptr<ManagedScript> script = *itr;
 		int type = script->GetScriptType();
 
-		if (script->IsPaused())
+		if (script->IsPaused()) {
 			script->runTime_ = 0;
+
+			//Paused scripts still get events, those mustn't pile up into the first frame after unpausing
+			script->ResetInstructionCount();
+			script->instructionCount_ = 0;
+		}
 		if (script->IsPaused() || (targetType != ManagedScript::TYPE_ALL && targetType != type)) {
 			++itr;
 			continue;
 		}
 
+		//Isolated scripts all run together at the position of the first one
+		if (script->isolationGroup_ >= 0 && !script->IsEndScript() && !bIsolatedRun) {
+			_RunIsolatedScripts(targetType);
+			bIsolatedRun = true;
+		}
+		if (bIsolatedRun && script->bIsolatedRun_) {
+			bHasCloseScriptWork_ |= script->IsEndScript();
+			++itr;
+			continue;
+		}
+
 		QueryPerformanceCounter(&startTime);
 		if (script->IsEndScript()) {
-			std::map<std::string, script_block*>::iterator itrEvent;
-			if (script->IsEventExists("Finalize", itrEvent))
-				script->Run(itrEvent);
+			if (script_block* pEvent = script->GetEvent(script_engine::EVENT_FINALIZE))
+				script->Run(pEvent);
 
 			bHasCloseScriptWork_ |= true;
+			if (script->HasEvent(script_engine::EVENT_EVENT))
+				listScriptEvent_.remove(script);
 			itr = listScriptRun_.erase(itr);
 		}
 		else {
-			std::map<std::string, script_block*>::iterator itrEvent;
-			if (script->IsEventExists("MainLoop", itrEvent))
-				script->Run(itrEvent);
+			if (script_block* pEvent = script->GetEvent(script_engine::EVENT_MAIN_LOOP))
+				script->Run(pEvent);
 
 			bHasCloseScriptWork_ |= script->IsEndScript();
 			++itr;
@@ -65,7 +249,89 @@ void ScriptManager::Work(int targetType) {
 		QueryPerformanceCounter(&endTime);
 
 		script->runTime_ = (endTime.QuadPart - startTime.QuadPart) * 1000000ULL / timeFreq.QuadPart;
+
+		//Includes events run since the last frame
+		script->instructionCount_ = script->ResetInstructionCount();
+	}
+}
+void ScriptManager::_RunIsolatedScripts(int targetType) {
+	std::vector<ManagedScript*> listScript;
+	for (auto& script : listScriptRun_) {
+		script->bIsolatedRun_ = false;
+		if (script->isolationGroup_ < 0) {
+			if (script->GetCallGate())
+				script->SetCallGate(nullptr);
+			continue;
+		}
+		if (script->IsPaused() || script->IsEndScript()) continue;
+		if (targetType != ManagedScript::TYPE_ALL && targetType != script->GetScriptType()) continue;
+		listScript.push_back(script.get());
+	}
+	if (listScript.size() == 0) return;
+
+	//Scripts with the same group ID or the same compiled code end up together, in run order
+	std::vector<size_t> listParent(listScript.size());
+	auto _FindRoot = [&](size_t i) {
+		while (listParent[i] != i)
+			i = listParent[i] = listParent[listParent[i]];
+		return i;
+	};
+	{
+		std::map<int, size_t> mapGroup;
+		std::map<ScriptEngineData*, size_t> mapEngine;
+		for (size_t i = 0; i < listScript.size(); ++i) {
+			listParent[i] = i;
+
+			auto itrGroup = mapGroup.insert(std::make_pair(listScript[i]->isolationGroup_, i)).first;
+			auto itrEngine = mapEngine.insert(std::make_pair(listScript[i]->engine_.get(), i)).first;
+			for (size_t other : { itrGroup->second, itrEngine->second }) {
+				size_t rootA = _FindRoot(i);
+				size_t rootB = _FindRoot(other);
+				if (rootA != rootB)
+					listParent[std::max(rootA, rootB)] = std::min(rootA, rootB);
+			}
+		}
+	}
+
+	std::vector<std::vector<ManagedScript*>> listGroup;
+	{
+		std::map<size_t, size_t> mapRootGroup;
+		for (size_t i = 0; i < listScript.size(); ++i) {
+			auto itr = mapRootGroup.insert(std::make_pair(_FindRoot(i), listGroup.size())).first;
+			if (itr->second == listGroup.size())
+				listGroup.emplace_back();
+			listGroup[itr->second].push_back(listScript[i]);
+		}
+	}
+
+	std::vector<ScriptIsolationGate::Job> listJob;
+	for (auto& group : listGroup) {
+		listJob.push_back([&group]() {
+			LARGE_INTEGER startTime, endTime;
+			LARGE_INTEGER timeFreq;
+			QueryPerformanceFrequency(&timeFreq);
+
+			for (ManagedScript* script : group) {
+				//Closed or paused by another script in the meantime, left to the main loop of Work
+				if (script->IsPaused() || script->IsEndScript()) continue;
+
+				QueryPerformanceCounter(&startTime);
+				script->bIsolatedRun_ = true;
+				if (script_block* pEvent = script->GetEvent(script_engine::EVENT_MAIN_LOOP))
+					script->Run(pEvent);
+				QueryPerformanceCounter(&endTime);
+
+				script->runTime_ = (endTime.QuadPart - startTime.QuadPart) * 1000000ULL / timeFreq.QuadPart;
+				script->instructionCount_ = script->ResetInstructionCount();
+			}
+		});
 	}
+	GetIsolationGate()->Run(listJob);
+}
+ScriptIsolationGate* ScriptManager::GetIsolationGate() {
+	if (gateIsolation_ == nullptr)
+		gateIsolation_.reset(new ScriptIsolationGate());
+	return gateIsolation_.get();
 }
 void ScriptManager::Render() {
 	//What?
@@ -145,6 +411,8 @@ void ScriptManager::StartScript(shared_ptr<ManagedScript> script, bool bUnload)
 		if (bUnload)
 			mapScriptLoad_.erase(script->GetScriptID());
 		listScriptRun_.push_back(script);
+		if (script->HasEvent(script_engine::EVENT_EVENT))
+			listScriptEvent_.push_back(script);
 	}
 
 	if (script) {
@@ -155,9 +423,8 @@ void ScriptManager::StartScript(shared_ptr<ManagedScript> script, bool bUnload)
 
 		script->Run();	//Execute code in the global scope
 
-		std::map<std::string, script_block*>::iterator itrEvent;
-		if (script->IsEventExists("Initialize", itrEvent))
-			script->Run(itrEvent);
+		if (script_block* pEvent = script->GetEvent(script_engine::EVENT_INITIALIZE))
+			script->Run(pEvent);
 	}
 }
 void ScriptManager::CloseScript(int64_t id) {
@@ -219,6 +486,7 @@ void ScriptManager::OrphanAllScripts() {
 
 		mapScriptLoad_.clear();
 		listScriptRun_.clear();
+		listScriptEvent_.clear();
 
 		/*
 		for (auto itr = listRelativeManager_.begin(); itr != listRelativeManager_.end(); ++itr) {
@@ -238,9 +506,8 @@ int64_t ScriptManager::_LoadScript(const std::wstring& path, shared_ptr<ManagedS
 	script->SetSourceFromFile(path);
 	script->Compile();
 
-	std::map<std::string, script_block*>::iterator itrEvent;
-	if (script->IsEventExists("Loading", itrEvent))
-		script->Run(itrEvent);
+	if (script_block* pEvent = script->GetEvent(script_engine::EVENT_LOADING))
+		script->Run(pEvent);
 
 	script->bLoad_ = true;
 	script->bRunning_ = false;
@@ -311,8 +578,9 @@ void ScriptManager::UnloadScript(shared_ptr<ManagedScript> script) {
 }
 
 void ScriptManager::RequestEventAll(int type, const gstd::value* listValue, size_t countArgument) {
+	//Only scripts that define @Event are visited
 	{
-		for (auto& pScript : listScriptRun_) {
+		for (auto& pScript : listScriptEvent_) {
 			if (pScript->IsEndScript() /*|| pScript->IsPaused()*/) continue;
 			pScript->RequestEvent(type, listValue, countArgument);
 		}
@@ -320,7 +588,7 @@ void ScriptManager::RequestEventAll(int type, const gstd::value* listValue, size
 
 	for (auto itrManager = listRelativeManager_.begin(); itrManager != listRelativeManager_.end(); ) {
 		if (auto manager = itrManager->lock()) {
-			for (auto& pScript : manager->listScriptRun_) {
+			for (auto& pScript : manager->listScriptEvent_) {
 				if (pScript->IsEndScript() /*|| pScript->IsPaused()*/) continue;
 				pScript->RequestEvent(type, listValue, countArgument);
 			}
@@ -386,6 +654,8 @@ static const std::vector<function> managedScriptFunction = {
 	{ "NotifyEventOwn", ManagedScript::Func_NotifyEventOwn, -2 },    //1 fixed (+ ...) -> 1 minimum
 	{ "NotifyEventAll", ManagedScript::Func_NotifyEventAll, -2 },    //1 fixed (+ ...) -> 1 minimum
 	{ "PauseScript", ManagedScript::Func_PauseScript, 2 },
+	{ "SetScriptInstructionBudget", ManagedScript::Func_SetScriptInstructionBudget, 2 },
+	{ "SetScriptIsolationGroup", ManagedScript::Func_SetScriptIsolationGroup, 2 },
 
 	{ "GetScriptStatus", ManagedScript::Func_GetScriptStatus, 1 },
 };
@@ -413,6 +683,13 @@ ManagedScript::ManagedScript() {
 	bPaused_ = false;
 
 	runTime_ = 0;
+	instructionCount_ = 0;
+
+	isolationGroup_ = -1;
+	bIsolatedRun_ = false;
+
+	SetInstructionBudget(ScriptManager::GetDefaultInstructionBudget(), 
+		ScriptManager::IsDefaultInstructionBudgetYield());
 
 	typeEvent_ = -1;
 	listValueEvent_ = nullptr;
@@ -445,13 +722,21 @@ void ManagedScript::SetScriptManager(ScriptManager* manager) {
 	mainThreadID_ = scriptManager_->GetMainThreadID();
 	idScript_ = scriptManager_->IssueScriptID();
 }
+//Scripts in a group >= 0 run their MainLoop on a worker thread, alongside the other groups
+void ManagedScript::SetIsolationGroup(int group) {
+	isolationGroup_ = group;
+
+	//Detached at the start of the next isolated batch instead, the script might be parked on a worker right now
+	if (group >= 0)
+		SetCallGate(scriptManager_->GetIsolationGate());
+}
 gstd::value ManagedScript::RequestEvent(int type) {
 	return RequestEvent(type, nullptr, 0);
 }
 gstd::value ManagedScript::RequestEvent(int type, const gstd::value* listValue, size_t countArgument) {
 	gstd::value res;
-	std::map<std::string, script_block*>::iterator itrEvent;
-	if (!IsEventExists("Event", itrEvent)) {
+	script_block* pEvent = GetEvent(script_engine::EVENT_EVENT);
+	if (pEvent == nullptr) {
 		return res;
 	}
 
@@ -466,7 +751,7 @@ gstd::value ManagedScript::RequestEvent(int type, const gstd::value* listValue,
 	listValueEventSize_ = countArgument;
 	valueRes_ = gstd::value();
 
-	Run(itrEvent);
+	Run(pEvent);
 	res = GetResultValue();
 
 	//Restore previous values
@@ -669,6 +954,36 @@ gstd::value ManagedScript::Func_PauseScript(script_machine* machine, int argc, c
 
 	return value();
 }
+gstd::value ManagedScript::Func_SetScriptInstructionBudget(script_machine* machine, int argc, const value* argv) {
+	ManagedScript* script = (ManagedScript*)machine->data;
+	script->CheckRunInMainThread();
+
+	auto scriptManager = script->scriptManager_;
+
+	int64_t idScript = argv[0].as_int();
+	int64_t budget = std::max<int64_t>(argv[1].as_int(), 0);
+
+	shared_ptr<ManagedScript> target = scriptManager->GetScript(idScript, true, true);
+	if (target)
+		target->SetInstructionBudget(budget, ScriptManager::IsDefaultInstructionBudgetYield());
+
+	return value();
+}
+gstd::value ManagedScript::Func_SetScriptIsolationGroup(script_machine* machine, int argc, const value* argv) {
+	ManagedScript* script = (ManagedScript*)machine->data;
+	script->CheckRunInMainThread();
+
+	auto scriptManager = script->scriptManager_;
+
+	int64_t idScript = argv[0].as_int();
+	int group = std::max<int64_t>(argv[1].as_int(), -1);
+
+	shared_ptr<ManagedScript> target = scriptManager->GetScript(idScript, true, true);
+	if (target)
+		target->SetIsolationGroup(group);
+
+	return value();
+}
 gstd::value ManagedScript::Func_GetScriptStatus(script_machine* machine, int argc, const value* argv) {
 	ManagedScript* script = (ManagedScript*)machine->data;
 	auto scriptManager = script->scriptManager_;
@@ -6,6 +6,65 @@
 
 namespace directx {
 	class ManagedScript;
+	//*******************************************************************
+	//ScriptIsolationGate
+	//	Runs isolated script groups on worker threads
+	//	Natives that aren't thread-safe are parked and run by the main thread in rounds,
+	//	one call from every parked worker in worker order, so the results don't depend on timing
+	//*******************************************************************
+	class ScriptIsolationGate : public gstd::script_call_gate {
+	public:
+		enum : size_t {
+			MAX_WORKER = 8,		//Fixed, so groups end up on the same workers on every computer
+		};
+		typedef std::function<void()> Job;
+	private:
+		enum : uint8_t {
+			WORKER_IDLE,
+			WORKER_RUNNING,
+			WORKER_PARKED,
+			WORKER_DONE,
+		};
+		struct Worker {
+			size_t index;
+			std::thread thread;
+			uint8_t state;
+
+			//Parked native call
+			gstd::script_machine* machine;
+			gstd::dnh_func_callback_t func;
+			int argc;
+			const gstd::value* argv;
+			gstd::value result;
+			std::exception_ptr error;
+		};
+	private:
+		static thread_local Worker* currentWorker_;
+
+		std::vector<unique_ptr<Worker>> listWorker_;
+		std::mutex mtx_;
+		std::condition_variable cvWorker_;
+		std::condition_variable cvMain_;
+		bool bStop_;
+
+		const std::vector<Job>* pListJob_;
+		std::vector<std::exception_ptr> listJobError_;
+
+		void _Run(Worker* worker);
+
+		static gstd::value _CallIsolated(gstd::script_machine* machine, gstd::dnh_func_callback_t func, 
+			int argc, const gstd::value* argv);
+		static gstd::value _Isolate(const gstd::value& v);
+	public:
+		ScriptIsolationGate();
+		virtual ~ScriptIsolationGate();
+
+		void Run(const std::vector<Job>& listJob);
+
+		virtual gstd::value call(gstd::script_machine* machine, gstd::dnh_func_callback_t func, 
+			int argc, const gstd::value* argv);
+	};
+
 	//*******************************************************************
 	//ScriptManager
 	//*******************************************************************
@@ -18,6 +77,10 @@ namespace directx {
 	protected:
 		static std::atomic<int64_t> idScript_;
 
+		//Per-frame instruction budget given to new scripts, 0 for no limit
+		static uint64_t defaultInstructionBudget_;
+		static bool bDefaultInstructionBudgetYield_;
+
 		gstd::CriticalSection lock_;
 
 		std::atomic_bool bCancelLoad_;
@@ -28,12 +91,16 @@ namespace directx {
 		std::wstring error_;
 		std::map<int64_t, shared_ptr<ManagedScript>> mapScriptLoad_;
 		std::list<shared_ptr<ManagedScript>> listScriptRun_;
+		std::list<shared_ptr<ManagedScript>> listScriptEvent_;		//Running scripts with an @Event, in run order
 		std::map<int64_t, gstd::value> mapClosedScriptResult_;
 		std::list<weak_ptr<ScriptManager>> listRelativeManager_;
 
+		unique_ptr<ScriptIsolationGate> gateIsolation_;
+
 		int mainThreadID_;
 
 		int64_t _LoadScript(const std::wstring& path, shared_ptr<ManagedScript> script);
+		void _RunIsolatedScripts(int targetType);
 	public:
 		ScriptManager();
 		virtual ~ScriptManager();
@@ -54,6 +121,15 @@ namespace directx {
 		int GetMainThreadID() { return mainThreadID_; }
 		int64_t IssueScriptID() { return ++idScript_; }
 
+		ScriptIsolationGate* GetIsolationGate();
+
+		static void SetDefaultInstructionBudget(uint64_t budget, bool bYield) {
+			defaultInstructionBudget_ = budget;
+			bDefaultInstructionBudgetYield_ = bYield;
+		}
+		static uint64_t GetDefaultInstructionBudget() { return defaultInstructionBudget_; }
+		static bool IsDefaultInstructionBudgetYield() { return bDefaultInstructionBudgetYield_; }
+
 		std::map<int64_t, shared_ptr<ManagedScript>>& GetMapScriptLoad() { return mapScriptLoad_; }
 		std::list<shared_ptr<ManagedScript>>& GetRunningScriptList() { return listScriptRun_; }
 		std::list<weak_ptr<ScriptManager>>& GetRelativeManagerList() { return listRelativeManager_; }
@@ -128,6 +204,10 @@ namespace directx {
 		std::atomic_bool bPaused_;
 
 		uint64_t runTime_;
+		uint64_t instructionCount_;		//Executed between the last two frames
+
+		int isolationGroup_;			//-1 if the script runs on the main thread
+		bool bIsolatedRun_;				//MainLoop already ran in this frame's isolated batch
 
 		int typeEvent_;
 		gstd::value* listValueEvent_;
@@ -156,6 +236,10 @@ namespace directx {
 		bool IsPaused() { return bPaused_; }
 
 		uint64_t GetScriptRunTime() { return runTime_; }
+		uint64_t GetInstructionCount() { return instructionCount_; }
+
+		void SetIsolationGroup(int group);
+		int GetIsolationGroup() { return isolationGroup_; }
 
 		gstd::value RequestEvent(int type);
 		gstd::value RequestEvent(int type, const gstd::value* listValue, size_t countArgument);
@@ -185,6 +269,8 @@ namespace directx {
 		DNH_FUNCAPI_DECL_(Func_NotifyEventOwn);
 		static gstd::value Func_NotifyEventAll(gstd::script_machine* machine, int argc, const gstd::value* argv);
 		DNH_FUNCAPI_DECL_(Func_PauseScript);
+		DNH_FUNCAPI_DECL_(Func_SetScriptInstructionBudget);
+		DNH_FUNCAPI_DECL_(Func_SetScriptIsolationGroup);
 
 		DNH_FUNCAPI_DECL_(Func_GetScriptStatus);
 	};
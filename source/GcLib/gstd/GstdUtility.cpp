@@ -83,6 +83,29 @@ void SystemUtility::TestCpuSupportSIMD() {
 #endif
 }
 
+bool SystemUtility::IsCpuSupportFMA() {
+#ifdef __L_MATH_VECTORIZE
+	static const bool bSupport = []() {
+		int cpui[4];
+		__cpuid(cpui, 0);
+		if (cpui[0] < 1) return false;
+
+		__cpuid(cpui, 1);
+		std::bitset<32> f_1_ECX = cpui[2];
+		bool hasFMA = f_1_ECX[12];
+		bool hasOSXSAVE = f_1_ECX[27];
+		bool hasAVX = f_1_ECX[28];
+		if (!hasFMA || !hasOSXSAVE || !hasAVX) return false;
+
+		//The OS must also save the YMM state
+		return (_xgetbv(0) & 0x6) == 0x6;
+	}();
+	return bSupport;
+#else
+	return false;
+#endif
+}
+
 std::wstring SystemUtility::GetSystemFontFilePath(const std::wstring& faceName) {
 	static const LPWSTR fontRegistryPath = L"Software\\Microsoft\\Windows NT\\CurrentVersion\\Fonts";
 
@@ -4,6 +4,7 @@
 
 #include "SmartPointer.hpp"
 #include "VectorExtension.hpp"
+#include "Thread.hpp"
 
 #include "GstdConstant.hpp"
 
@@ -25,6 +26,8 @@ namespace gstd {
 	class SystemUtility {
 	public:
 		static void TestCpuSupportSIMD();
+		//Whether FMA3 instructions are available and enabled by the OS
+		static bool IsCpuSupportFMA();
 
 		static stdch::steady_clock::time_point GetCpuTime() {
 			return stdch::steady_clock::now();
@@ -45,25 +48,20 @@ namespace gstd {
 
 	//================================================================
 	//ThreadUtility
+	//Runs func(i) for i in [0, countLoop) on the global thread pool, grain of 0 picks a chunk size automatically
 	template<class F>
-	static void ParallelFor(size_t countLoop, F&& func) {
-		size_t countCore = std::max(std::thread::hardware_concurrency(), 1U);
-
-		std::vector<std::future<void>> workers;
-		workers.reserve(countCore);
-
-		auto coreTask = [&](size_t id) {
-			const size_t begin = countLoop / countCore * id + std::min(countLoop % countCore, id);
-			const size_t end = countLoop / countCore * (id + 1U) + std::min(countLoop % countCore, id + 1U);
+	static void ParallelFor(size_t countLoop, F&& func, size_t grain = 0) {
+		if (countLoop <= 1) {
+			for (size_t i = 0; i < countLoop; ++i)
+				func(i);
+			return;
+		}
 
+		ThreadPool::RangeFunction rangeTask = [&](size_t begin, size_t end) {
 			for (size_t i = begin; i < end; ++i)
 				func(i);
 		};
-
-		for (size_t iCore = 0; iCore < countCore; ++iCore)
-			workers.emplace_back(std::async(std::launch::async | std::launch::deferred, coreTask, iCore));
-		for (const auto& worker : workers)
-			worker.wait();
+		ThreadPool::GetBase()->ParallelFor(countLoop, grain, rangeTask);
 	}
 
 	//================================================================
@@ -12,6 +12,7 @@ script_block::script_block(uint32_t the_level, block_kind the_kind) {
 	level = the_level;
 	arguments = 0;
 	func = nullptr;
+	intrinsic = command_kind::pc_nop;
 	kind = the_kind;
 }
 
@@ -126,8 +127,8 @@ static const std::vector<function> base_operations = {
 
 	{ "round", BaseFunction::round, 1 },
 	{ "round_base", BaseFunction::round_base, 2 },
-	{ "trunc", BaseFunction::truncate, 1 },
-	{ "truncate", BaseFunction::truncate, 1 },
+	{ "trunc", BaseFunction::truncate, 1, command_kind::pc_inline_trunc },
+	{ "truncate", BaseFunction::truncate, 1, command_kind::pc_inline_trunc },
 	{ "ceil", BaseFunction::ceil, 1 },
 	{ "ceil_base", BaseFunction::ceil_base, 2 },
 	{ "floor", BaseFunction::floor, 1 },
@@ -257,6 +258,9 @@ parser::parser(script_engine* e, script_scanner* s) {
 		engine->main_block->codes.push_back(code(command_kind::pc_call, (uint32_t)block_const_reg, 0));
 	}
 }
+const std::vector<function>* parser::get_base_operations() {
+	return &base_operations;
+}
 void parser::load_functions(std::vector<function>* list_func) {
 	//Client script function extensions
 	for (auto itr = list_func->begin(); itr != list_func->end(); ++itr)
@@ -331,11 +335,19 @@ void parser::begin_parse() {
 	}
 }
 
+void parser::optimize_peephole() {
+	for (script_block& iBlock : engine->blocks) {
+		optimize_control_flow(&iBlock);
+		fuse_superinstructions(&iBlock);
+	}
+}
+
 void parser::register_function(const function& func) {
 	script_block* block = engine->new_block(0, block_kind::bk_function);
 	block->arguments = func.argc;
 	block->name = func.name;
 	block->func = func.func;
+	block->intrinsic = func.intrinsic;
 	symbol s = symbol(0, nullptr, false, block);
 	frame.begin()->singular_insert(func.name, s, func.argc);
 }
@@ -454,6 +466,57 @@ type_data* _token_kind_to_type_data(token_kind token) {
 	return script_type_manager::get_null_type();
 }
 
+static inline bool _is_int_type(type_data* type) {
+	return type != nullptr && type->get_kind() == type_data::tk_int;
+}
+static inline bool _is_numeric_type(type_data* type) {
+	return type != nullptr && (type->get_kind() & (type_data::tk_int | type_data::tk_float)) != 0;
+}
+
+//Picks the typed variant of an arithmetic or comparison operation, and the type of its result
+//	Returns the operation unchanged if either operand type isn't known to be int or float
+static command_kind _get_typed_operation(command_kind op, type_data* type_l, type_data* type_r, type_data** pResType) {
+	*pResType = nullptr;
+	if (!_is_numeric_type(type_l) || !_is_numeric_type(type_r))
+		return op;
+
+	bool bInt = _is_int_type(type_l) && _is_int_type(type_r);
+	type_data* typeNum = bInt ? script_type_manager::get_int_type() : script_type_manager::get_float_type();
+
+	switch (op) {
+	case command_kind::pc_inline_add:
+		*pResType = typeNum;
+		return bInt ? command_kind::pc_inline_add_int : command_kind::pc_inline_add_float;
+	case command_kind::pc_inline_sub:
+		*pResType = typeNum;
+		return bInt ? command_kind::pc_inline_sub_int : command_kind::pc_inline_sub_float;
+	case command_kind::pc_inline_mul:
+		*pResType = typeNum;
+		return bInt ? command_kind::pc_inline_mul_int : command_kind::pc_inline_mul_float;
+	case command_kind::pc_inline_div:
+		*pResType = script_type_manager::get_float_type();
+		return command_kind::pc_inline_div_float;
+	case command_kind::pc_inline_fdiv:
+		*pResType = script_type_manager::get_int_type();
+		return bInt ? command_kind::pc_inline_fdiv_int : command_kind::pc_inline_fdiv_float;
+	case command_kind::pc_inline_mod:
+		*pResType = typeNum;
+		return bInt ? command_kind::pc_inline_mod_int : command_kind::pc_inline_mod_float;
+	case command_kind::pc_inline_pow:
+		*pResType = typeNum;
+		return op;
+	case command_kind::pc_inline_cmp_e:
+	case command_kind::pc_inline_cmp_g:
+	case command_kind::pc_inline_cmp_ge:
+	case command_kind::pc_inline_cmp_l:
+	case command_kind::pc_inline_cmp_le:
+	case command_kind::pc_inline_cmp_ne:
+		*pResType = script_type_manager::get_boolean_type();
+		return bInt ? command_kind::pc_inline_cmp_int : command_kind::pc_inline_cmp_float;
+	}
+	return op;
+}
+
 parser::arg_data parser::parse_variable_decl(parser_state_t* state, bool bParameter) {
 	arg_data var;
 
@@ -800,16 +863,19 @@ void parser::parse_parentheses(script_block* block, parser_state_t* state) {
 
 void parser::parse_clause(script_block* block, parser_state_t* state) {
 	//_parser_assert_nend(state);
+	state->expr_type = nullptr;
 	switch (state->next()) {
 	case token_kind::tk_int:
 		state->AddCode(block, code(command_kind::pc_push_value,
 			value(script_type_manager::get_int_type(), state->lex->int_value)));
 		state->advance();
+		state->expr_type = script_type_manager::get_int_type();
 		return;
 	case token_kind::tk_float:
 		state->AddCode(block, code(command_kind::pc_push_value,
 			value(script_type_manager::get_float_type(), state->lex->float_value)));
 		state->advance();
+		state->expr_type = script_type_manager::get_float_type();
 		return;
 	case token_kind::tk_char:
 		state->AddCode(block, code(command_kind::pc_push_value,
@@ -880,11 +946,19 @@ continue_as_variadic:
 			parse_arguments(block, state, &s->argData);
 			parser_assert(state, s->sub->kind == block_kind::bk_function,
 				"Tasks and subs cannot return values.\r\n");
-			state->AddCode(block, code(command_kind::pc_call_and_push_result, (uint32_t)s->sub, argc));
+			if (s->sub->intrinsic != command_kind::pc_nop && s->sub->arguments == argc) {
+				state->AddCode(block, code(s->sub->intrinsic, (uint32_t)argc));
+				state->expr_type = script_type_manager::get_float_type();
+			}
+			else {
+				state->AddCode(block, code(command_kind::pc_call_and_push_result, (uint32_t)s->sub, argc));
+				state->expr_type = nullptr;
+			}
 		}
 		else {
 			//Variable
 			state->AddCode(block, code(command_kind::pc_push_variable, s->level, s->var, name));
+			state->expr_type = s->type;
 		}
 
 		return;
@@ -926,12 +1000,14 @@ continue_as_variadic:
 		state->advance();
 		parse_parentheses(block, state);
 		state->AddCode(block, code(command_kind::pc_inline_cast_var, (uint32_t)target, false));
+		state->expr_type = target;
 		return;
 	}
 	case token_kind::tk_LENGTH:
 		state->advance();
 		parse_parentheses(block, state);
 		state->AddCode(block, code(command_kind::pc_inline_length_array));
+		state->expr_type = script_type_manager::get_int_type();
 		return;
 	case token_kind::tk_GET_FUNC:
 	{
@@ -993,6 +1069,7 @@ continue_as_variadic:
 
 		state->AddCode(block, code(command_kind::pc_push_value,
 			value(script_type_manager::get_int_type(), (int64_t&)val)));
+		state->expr_type = script_type_manager::get_int_type();
 
 		return;
 	}
@@ -1018,6 +1095,7 @@ continue_as_variadic:
 
 		parser_assert(state, state->next() == token_kind::tk_close_bra, "\"]\" is required.\r\n");
 		state->advance();
+		state->expr_type = nullptr;
 
 		return;
 	}
@@ -1027,6 +1105,7 @@ continue_as_variadic:
 		state->AddCode(block, code(command_kind::pc_inline_abs));
 		parser_assert(state, state->next() == token_kind::tk_close_abs, "\"|)\" is required.\r\n");
 		state->advance();
+		state->expr_type = script_type_manager::get_float_type();
 		return;
 	case token_kind::tk_open_par:
 		parse_parentheses(block, state);
@@ -1054,7 +1133,11 @@ size_t parser::_parse_array_suffix_lvalue(script_block* block, parser_state_t* s
 	return indexcount;
 }
 void parser::_parse_array_suffix_rvalue(script_block* block, parser_state_t* state) {
+	type_data* typeBase = state->expr_type;
+	bool bIndexed = false;
 	while (state->next() == token_kind::tk_open_bra) {
+		bIndexed = true;
+
 		state->advance();
 		parse_ternary(block, state);
 
@@ -1070,13 +1153,16 @@ void parser::_parse_array_suffix_rvalue(script_block* block, parser_state_t* sta
 		parser_assert(state, state->next() == token_kind::tk_close_bra, "\"]\" is required.\r\n");
 		state->advance();
 	}
+	state->expr_type = bIndexed ? nullptr : typeBase;
 }
 void parser::parse_suffix(script_block* block, parser_state_t* state) {
 	parse_clause(block, state);
 	if (state->next() == token_kind::tk_caret) {
+		type_data* typeL = state->expr_type;
 		state->advance();
 		parse_suffix(block, state);
 		state->AddCode(block, code(command_kind::pc_inline_pow));
+		_get_typed_operation(command_kind::pc_inline_pow, typeL, state->expr_type, &state->expr_type);
 	}
 	else {
 		_parse_array_suffix_rvalue(block, state);
@@ -1093,16 +1179,20 @@ void parser::parse_prefix(script_block* block, parser_state_t* state) {
 		state->advance();
 		parse_prefix(block, state);
 		state->AddCode(block, code(command_kind::pc_inline_neg));
+		if (!_is_numeric_type(state->expr_type))
+			state->expr_type = nullptr;
 		return;
 	case token_kind::tk_exclamation:	//Logical NOT
 		state->advance();
 		parse_prefix(block, state);
 		state->AddCode(block, code(command_kind::pc_inline_not));
+		state->expr_type = script_type_manager::get_boolean_type();
 		return;
 	case token_kind::tk_tilde:			//Bitwise NOT
 		state->advance();
 		parse_prefix(block, state);
 		write_operation(block, state, "bit_not", 1);
+		state->expr_type = nullptr;
 		return;
 	default:
 		parse_suffix(block, state);
@@ -1120,8 +1210,10 @@ void parser::parse_product(script_block* block, parser_state_t* state) {
 		case token_kind::tk_slash: f = command_kind::pc_inline_div; break;
 		case token_kind::tk_f_slash: f = command_kind::pc_inline_fdiv; break;
 		}
+		type_data* typeL = state->expr_type;
 		state->advance();
 		parse_prefix(block, state);
+		f = _get_typed_operation(f, typeL, state->expr_type, &state->expr_type);
 		state->AddCode(block, code(f));
 	}
 }
@@ -1136,8 +1228,10 @@ void parser::parse_sum(script_block* block, parser_state_t* state) {
 		case token_kind::tk_tilde: f = command_kind::pc_inline_cat; break;
 		case token_kind::tk_plus: f = command_kind::pc_inline_add; break;
 		}
+		type_data* typeL = state->expr_type;
 		state->advance();
 		parse_product(block, state);
+		f = _get_typed_operation(f, typeL, state->expr_type, &state->expr_type);
 		state->AddCode(block, code(f));
 	}
 }
@@ -1149,6 +1243,7 @@ void parser::parse_bitwise_shift(script_block* block, parser_state_t* state) {
 		state->advance();
 		parse_sum(block, state);
 		write_operation(block, state, f, 2);
+		state->expr_type = nullptr;
 	}
 }
 
@@ -1165,30 +1260,26 @@ void parser::parse_comparison(script_block* block, parser_state_t* state) {
 	case token_kind::tk_le:
 	case token_kind::tk_ne:
 		token_kind op = state->next();
+		type_data* typeL = state->expr_type;
 		state->advance();
 		parse_bitwise_shift(block, state);
 
+		command_kind f = command_kind::pc_inline_cmp_ne;	//tk_ne
 		switch (op) {
-		case token_kind::tk_e:
-			state->AddCode(block, code(command_kind::pc_inline_cmp_e));
-			break;
-		case token_kind::tk_g:
-			state->AddCode(block, code(command_kind::pc_inline_cmp_g));
-			break;
-		case token_kind::tk_ge:
-			state->AddCode(block, code(command_kind::pc_inline_cmp_ge));
-			break;
-		case token_kind::tk_l:
-			state->AddCode(block, code(command_kind::pc_inline_cmp_l));
-			break;
-		case token_kind::tk_le:
-			state->AddCode(block, code(command_kind::pc_inline_cmp_le));
-			break;
-		case token_kind::tk_ne:
-			state->AddCode(block, code(command_kind::pc_inline_cmp_ne));
-			break;
+		case token_kind::tk_e: f = command_kind::pc_inline_cmp_e; break;
+		case token_kind::tk_g: f = command_kind::pc_inline_cmp_g; break;
+		case token_kind::tk_ge: f = command_kind::pc_inline_cmp_ge; break;
+		case token_kind::tk_l: f = command_kind::pc_inline_cmp_l; break;
+		case token_kind::tk_le: f = command_kind::pc_inline_cmp_le; break;
 		}
 
+		command_kind fTyped = _get_typed_operation(f, typeL, state->expr_type, &state->expr_type);
+		if (fTyped != f)
+			state->AddCode(block, code(fTyped, (uint32_t)f));
+		else
+			state->AddCode(block, code(f));
+		state->expr_type = script_type_manager::get_boolean_type();
+
 		break;
 	}
 }
@@ -1200,6 +1291,7 @@ void parser::parse_bitwise(script_block* block, parser_state_t* state) {
 			state->advance();
 			parse_comparison(block, state);
 			write_operation(block, state, "bit_and", 2);
+			state->expr_type = nullptr;
 		}
 	};
 	auto ParseOR = [&]() {
@@ -1208,6 +1300,7 @@ void parser::parse_bitwise(script_block* block, parser_state_t* state) {
 			state->advance();
 			ParseAND();
 			write_operation(block, state, "bit_or", 2);
+			state->expr_type = nullptr;
 		}
 	};
 
@@ -1216,6 +1309,7 @@ void parser::parse_bitwise(script_block* block, parser_state_t* state) {
 		state->advance();
 		ParseOR();
 		write_operation(block, state, "bit_xor", 2);
+		state->expr_type = nullptr;
 	}
 }
 
@@ -1250,6 +1344,7 @@ void parser::parse_logic(script_block* block, parser_state_t* state) {
 	if (hasExpr) {
 		state->AddCode(block, code(command_kind::pc_inline_cast_var,
 			(uint32_t)script_type_manager::get_boolean_type(), false));
+		state->expr_type = script_type_manager::get_boolean_type();
 	}
 }
 
@@ -1280,6 +1375,8 @@ void parser::parse_ternary(script_block* block, parser_state_t* state) {
 		//Exit point
 		state->AddCode(block, code(command_kind::pc_jump_target, hashJ2));
 		--(state->ip);
+
+		state->expr_type = nullptr;
 	}
 }
 
@@ -1373,6 +1470,10 @@ void parser::parse_single_statement(script_block* block, parser_state_t* state,
 		case token_kind::tk_assign:
 			assert_const(s, name);
 			state->advance();
+
+			//The last index is written with pc_inline_set_array, no element reference needed
+			if (isArrayElement)
+				state->PopCode(block);
 			parse_expression(block, state);
 
 			s->bAssigned = true;
@@ -1387,7 +1488,7 @@ void parser::parse_single_statement(script_block* block, parser_state_t* state,
 			}
 
 			if (isArrayElement)
-				state->AddCode(block, code(command_kind::pc_ref_assign));
+				state->AddCode(block, code(command_kind::pc_inline_set_array));
 			else 
 				state->AddCode(block, code(command_kind::pc_copy_assign, s->level, s->var, name));
 			break;
@@ -2493,6 +2594,16 @@ size_t parser::parse_block_inlined(script_block* block, parser_state_t* state, b
 void parser::optimize_expression(script_block* block, parser_state_t* state) {
 	std::vector<code> newCodes;
 
+	//Jumps from inner expressions are already linked, don't move code around them
+	bool bHasJump = false;
+	for (code& iCode : block->codes) {
+		command_kind op = iCode.GetOp();
+		if (op >= command_kind::pc_jump && op <= command_kind::pc_jump_if_not_nopop) {
+			bHasJump = true;
+			break;
+		}
+	}
+
 	for (auto iSrcCode = block->codes.begin(); iSrcCode != block->codes.end(); ++iSrcCode) {
 		switch (iSrcCode->GetOp()) {
 		case command_kind::pc_inline_neg:
@@ -2529,6 +2640,15 @@ void parser::optimize_expression(script_block* block, parser_state_t* state) {
 		case command_kind::pc_inline_div:
 		case command_kind::pc_inline_mod:
 		case command_kind::pc_inline_pow:
+		case command_kind::pc_inline_add_int:
+		case command_kind::pc_inline_sub_int:
+		case command_kind::pc_inline_mul_int:
+		case command_kind::pc_inline_mod_int:
+		case command_kind::pc_inline_add_float:
+		case command_kind::pc_inline_sub_float:
+		case command_kind::pc_inline_mul_float:
+		case command_kind::pc_inline_div_float:
+		case command_kind::pc_inline_mod_float:
 		{
 			code* ptrBack = &newCodes.back();
 			if (ptrBack[-1].GetOp() == command_kind::pc_push_value && ptrBack->GetOp() == command_kind::pc_push_value) {
@@ -2536,18 +2656,27 @@ void parser::optimize_expression(script_block* block, parser_state_t* state) {
 				value res;
 				switch (iSrcCode->GetOp()) {
 				case command_kind::pc_inline_add:
+				case command_kind::pc_inline_add_int:
+				case command_kind::pc_inline_add_float:
 					res = BaseFunction::_script_add(2, arg);
 					break;
 				case command_kind::pc_inline_sub:
+				case command_kind::pc_inline_sub_int:
+				case command_kind::pc_inline_sub_float:
 					res = BaseFunction::_script_subtract(2, arg);
 					break;
 				case command_kind::pc_inline_mul:
+				case command_kind::pc_inline_mul_int:
+				case command_kind::pc_inline_mul_float:
 					res = BaseFunction::_script_multiply(2, arg);
 					break;
 				case command_kind::pc_inline_div:
+				case command_kind::pc_inline_div_float:
 					res = BaseFunction::_script_divide(2, arg);
 					break;
 				case command_kind::pc_inline_mod:
+				case command_kind::pc_inline_mod_int:
+				case command_kind::pc_inline_mod_float:
 					res = BaseFunction::_script_remainder_(2, arg);
 					break;
 				case command_kind::pc_inline_pow:
@@ -2629,6 +2758,46 @@ lab_opt_construct_array_cancel:
 			}
 			break;
 		}
+		/* Fuses
+		 *		pc_push_value		a
+		 *		pc_push_value		b
+		 *		pc_inline_atan2		2
+		 * into
+		 *		pc_push_value		atan2(a, b)
+		 */
+		case command_kind::pc_inline_sin:
+		case command_kind::pc_inline_cos:
+		case command_kind::pc_inline_rsin:
+		case command_kind::pc_inline_rcos:
+		case command_kind::pc_inline_atan2:
+		case command_kind::pc_inline_ratan2:
+		case command_kind::pc_inline_sqrt:
+		case command_kind::pc_inline_hypot:
+		case command_kind::pc_inline_distance:
+		case command_kind::pc_inline_trunc:
+		{
+			size_t argc = iSrcCode->arg0;
+			bool bFold = !bHasJump && argc > 0 && argc <= 4 && newCodes.size() >= argc;
+			for (size_t i = 0; bFold && i < argc; ++i)
+				bFold = newCodes[newCodes.size() - argc + i].GetOp() == command_kind::pc_push_value;
+
+			if (bFold) {
+				value arg[4];
+				for (size_t i = 0; i < argc; ++i)
+					arg[i] = newCodes[newCodes.size() - argc + i].data;
+				double res = BaseFunction::_script_intrinsic(iSrcCode->GetOp(), arg);
+
+				for (size_t i = 0; i < argc; ++i)
+					newCodes.pop_back();
+				newCodes.push_back(code(iSrcCode->GetLine(), command_kind::pc_push_value,
+					value(script_type_manager::get_float_type(), res)));
+				state->ip -= argc;
+			}
+			else {
+				newCodes.push_back(*iSrcCode);
+			}
+			break;
+		}
 		case command_kind::pc_load_ptr:
 		{
 			code* ptrBack = &newCodes.back();
@@ -2717,6 +2886,342 @@ void parser::link_break_continue(script_block* block, parser_state_t* state,
 	}
 }
 
+//Fuses common sequences of linked code into superinstructions and remaps the jumps around them
+void parser::fuse_superinstructions(script_block* block) {
+	std::vector<code>& codes = block->codes;
+	if (codes.size() < 2U) return;
+
+	auto IsJump = [](command_kind op) {
+		switch (op) {
+		case command_kind::pc_jump:
+		case command_kind::pc_jump_if:
+		case command_kind::pc_jump_if_not:
+		case command_kind::pc_jump_if_nopop:
+		case command_kind::pc_jump_if_not_nopop:
+		case command_kind::pc_loop_count_jump:
+		case command_kind::pc_loop_ascent_jump:
+		case command_kind::pc_loop_descent_jump:
+		case command_kind::pc_cmp_jump:
+			return true;
+		}
+		return false;
+	};
+	auto IsOperand = [](command_kind op) {
+		return op == command_kind::pc_push_value || op == command_kind::pc_push_variable;
+	};
+	auto IsCompare = [](command_kind op) {
+		return (op >= command_kind::pc_inline_cmp_e && op <= command_kind::pc_inline_cmp_ne)
+			|| op == command_kind::pc_inline_cmp_int || op == command_kind::pc_inline_cmp_float;
+	};
+	auto IsArith = [](command_kind op) {
+		return (op >= command_kind::pc_inline_add && op <= command_kind::pc_inline_pow)
+			|| (op >= command_kind::pc_inline_add_int && op <= command_kind::pc_inline_mod_float);
+	};
+	auto IsArithAssign = [](command_kind op) {
+		return op >= command_kind::pc_inline_add_asi && op <= command_kind::pc_inline_pow_asi;
+	};
+
+	//A sequence can't be fused if something jumps into the middle of it
+	std::vector<bool> listJumpTarget(codes.size() + 1U, false);
+	for (code& iCode : codes) {
+		if (IsJump(iCode.GetOp()) && iCode.arg0 <= codes.size())
+			listJumpTarget[iCode.arg0] = true;
+	}
+	auto CanFuse = [&](size_t ip, size_t count) {
+		if (ip + count > codes.size()) return false;
+		for (size_t i = ip + 1; i < ip + count; ++i) {
+			if (listJumpTarget[i]) return false;
+		}
+		return true;
+	};
+
+	std::vector<code> newCodes;
+	newCodes.reserve(codes.size());
+	std::vector<size_t> mapIp(codes.size() + 1U);
+
+	for (size_t ip = 0; ip < codes.size();) {
+		code* c = &codes[ip];
+		size_t ipNew = newCodes.size();
+		size_t count = 1;
+
+		command_kind op0 = c[0].GetOp();
+		command_kind op1 = ip + 1 < codes.size() ? c[1].GetOp() : command_kind::pc_nop;
+		command_kind op2 = ip + 2 < codes.size() ? c[2].GetOp() : command_kind::pc_nop;
+		command_kind op3 = ip + 3 < codes.size() ? c[3].GetOp() : command_kind::pc_nop;
+
+		/* Fuses
+		 *		pc_loop_count
+		 *		pc_jump_if_not		x
+		 * into
+		 *		pc_loop_count_jump	x
+		 */
+		if (op0 == command_kind::pc_loop_count && op1 == command_kind::pc_jump_if_not && CanFuse(ip, 2)) {
+			newCodes.push_back(code(c[1].GetLine(), command_kind::pc_loop_count_jump, c[1].arg0));
+			count = 2;
+		}
+		else if ((op0 == command_kind::pc_loop_ascent || op0 == command_kind::pc_loop_descent)
+			&& op1 == command_kind::pc_jump_if && CanFuse(ip, 2))
+		{
+			command_kind opFused = op0 == command_kind::pc_loop_ascent ? 
+				command_kind::pc_loop_ascent_jump : command_kind::pc_loop_descent_jump;
+			newCodes.push_back(code(c[0].GetLine(), opFused, c[1].arg0));
+			count = 2;
+		}
+		/* Fuses
+		 *		[a]
+		 *		[b]
+		 *		pc_inline_cmp_l
+		 *		pc_jump_if_not		x
+		 * into
+		 *		pc_cmp_jump			x, (pc_inline_cmp_l | 0)
+		 *		[a]
+		 *		[b]
+		 */
+		else if (IsOperand(op0) && IsOperand(op1) && IsCompare(op2)
+			&& (op3 == command_kind::pc_jump_if || op3 == command_kind::pc_jump_if_not) && CanFuse(ip, 4))
+		{
+			uint32_t cond = op3 == command_kind::pc_jump_if ? 0x100 : 0;
+			if (op2 == command_kind::pc_inline_cmp_int || op2 == command_kind::pc_inline_cmp_float)
+				cond |= (c[2].arg0 & 0xff) | ((uint32_t)op2 << 16);
+			else
+				cond |= (uint32_t)op2;
+			code head(command_kind::pc_cmp_jump, c[3].arg0, cond);
+			head.SetLine(c[2].GetLine());
+			newCodes.push_back(head);
+			newCodes.push_back(c[0]);
+			newCodes.push_back(c[1]);
+			count = 4;
+		}
+		/* Fuses
+		 *		[a]
+		 *		[b]
+		 *		pc_inline_add
+		 *		pc_copy_assign		var
+		 * into
+		 *		pc_op_assign		pc_inline_add, var
+		 *		[a]
+		 *		[b]
+		 */
+		else if (IsOperand(op0) && IsOperand(op1) && IsArith(op2)
+			&& op3 == command_kind::pc_copy_assign && c[3].arg0 <= 0xfff && c[3].arg1 <= 0xfffff && CanFuse(ip, 4))
+		{
+			uint32_t var = (((uint32_t)c[3].arg0 & 0xfff) << 20) | (c[3].arg1 & 0xfffff);
+			code head = c[3];
+			head.SetOp(command_kind::pc_op_assign);
+			head.arg0 = (uint32_t)op2;
+			head.arg1 = var;
+			newCodes.push_back(head);
+			newCodes.push_back(c[0]);
+			newCodes.push_back(c[1]);
+			count = 4;
+		}
+		/* Fuses
+		 *		[a]
+		 *		pc_inline_add_asi	true, var
+		 * into
+		 *		pc_op_asi			pc_inline_add, var
+		 *		[a]
+		 */
+		else if (IsOperand(op0) && IsArithAssign(op1) && c[1].arg0 && CanFuse(ip, 2)) {
+			command_kind opArith = (command_kind)((uint32_t)op1
+				- (uint32_t)command_kind::pc_inline_add_asi + (uint32_t)command_kind::pc_inline_add);
+			code head = c[1];
+			head.SetOp(command_kind::pc_op_asi);
+			head.arg0 = (uint32_t)opArith;
+			newCodes.push_back(head);
+			newCodes.push_back(c[0]);
+			count = 2;
+		}
+		else {
+			newCodes.push_back(*c);
+		}
+
+		for (size_t i = 0; i < count; ++i)
+			mapIp[ip + i] = ipNew;
+		ip += count;
+	}
+	mapIp[codes.size()] = newCodes.size();
+
+	for (code& iCode : newCodes) {
+		if (IsJump(iCode.GetOp()) && iCode.arg0 < mapIp.size())
+			iCode.arg0 = mapIp[iCode.arg0];
+	}
+	codes = newCodes;
+}
+
+//Removes unreachable code, threads chains of jumps and folds branches on constant conditions
+void parser::optimize_control_flow(script_block* block) {
+	std::vector<code>& codes = block->codes;
+
+	auto IsJump = [](command_kind op) {
+		switch (op) {
+		case command_kind::pc_jump:
+		case command_kind::pc_jump_if:
+		case command_kind::pc_jump_if_not:
+		case command_kind::pc_jump_if_nopop:
+		case command_kind::pc_jump_if_not_nopop:
+			return true;
+		}
+		return false;
+	};
+	auto IsCondJump = [](command_kind op) {
+		return op == command_kind::pc_jump_if || op == command_kind::pc_jump_if_not
+			|| op == command_kind::pc_jump_if_nopop || op == command_kind::pc_jump_if_not_nopop;
+	};
+	auto IsNoPop = [](command_kind op) {
+		return op == command_kind::pc_jump_if_nopop || op == command_kind::pc_jump_if_not_nopop;
+	};
+	auto IsJumpIfTrue = [](command_kind op) {
+		return op == command_kind::pc_jump_if || op == command_kind::pc_jump_if_nopop;
+	};
+
+	//Removing code can expose more work for the next pass, stop once nothing is removed
+	for (size_t countCode = codes.size(); countCode > 0U; countCode = codes.size()) {
+
+		std::vector<bool> listJumpTarget(countCode + 1U, false);
+		for (code& iCode : codes) {
+			if (IsJump(iCode.GetOp()) && iCode.arg0 <= countCode)
+				listJumpTarget[iCode.arg0] = true;
+		}
+
+		/* Folds
+		 *		pc_push_value		true
+		 *		pc_jump_if_not		x
+		 * into nothing, and
+		 *		pc_push_value		false
+		 *		pc_jump_if_not		x
+		 * into
+		 *		pc_jump				x
+		 */
+		for (size_t ip = 0; ip + 1 < countCode; ++ip) {
+			command_kind opJump = codes[ip + 1].GetOp();
+			if (codes[ip].GetOp() != command_kind::pc_push_value || !IsCondJump(opJump)
+				|| listJumpTarget[ip + 1]) continue;
+
+			bool bTaken = codes[ip].data.as_boolean() == IsJumpIfTrue(opJump);
+			code codeJump = bTaken ? code(codes[ip + 1].GetLine(), command_kind::pc_jump, codes[ip + 1].arg0)
+				: code(command_kind::pc_nop);
+			if (IsNoPop(opJump)) {
+				codes[ip + 1] = codeJump;
+			}
+			else {
+				codes[ip] = codeJump;
+				codes[ip + 1] = code(command_kind::pc_nop);
+			}
+			++ip;
+		}
+
+		/* Folds the case tests of an alternative on a constant,
+		 *		pc_push_value		c
+		 *		pc_dup_n			0
+		 *		pc_push_value		k
+		 *		pc_inline_cmp_e
+		 *		pc_jump_if			x
+		 * into
+		 *		pc_push_value		c
+		 *		pc_jump				x
+		 * if c == k, and just pc_push_value c otherwise
+		 * Once the failed case is removed the next one follows c, and gets folded on the next pass
+		 */
+		for (size_t ip = 0; ip + 4 < countCode; ++ip) {
+			if (codes[ip].GetOp() != command_kind::pc_push_value
+				|| codes[ip + 1].GetOp() != command_kind::pc_dup_n || codes[ip + 1].arg0 != 0
+				|| codes[ip + 2].GetOp() != command_kind::pc_push_value
+				|| codes[ip + 3].GetOp() != command_kind::pc_inline_cmp_e
+				|| codes[ip + 4].GetOp() != command_kind::pc_jump_if) continue;
+			if (listJumpTarget[ip + 1] || listJumpTarget[ip + 2] || listJumpTarget[ip + 3]
+				|| listJumpTarget[ip + 4]) continue;
+
+			bool bEqual = false;
+			try {
+				value arg[2] = { codes[ip].data, codes[ip + 2].data };
+				bEqual = BaseFunction::_script_compare(2, arg).as_int() == 0;
+			}
+			catch (std::string&) {
+				continue;	//Incomparable types, leave the error to runtime
+			}
+
+			codes[ip + 1] = bEqual ? code(codes[ip + 4].GetLine(), command_kind::pc_jump, codes[ip + 4].arg0)
+				: code(command_kind::pc_nop);
+			for (size_t i = ip + 2; i <= ip + 4; ++i)
+				codes[i] = code(command_kind::pc_nop);
+			ip += 4;
+		}
+
+		//Points jumps that land on another jump directly to where that one goes
+		auto GetThreadedTarget = [&](command_kind op, size_t target) -> size_t {
+			for (size_t i = 0; i < countCode && target < countCode; ++i) {
+				const code& next = codes[target];
+				command_kind opNext = next.GetOp();
+				if (opNext == command_kind::pc_nop)
+					++target;
+				else if (opNext == command_kind::pc_jump)
+					target = next.arg0;
+				else if (IsNoPop(op) && IsNoPop(opNext))	//Same condition value still on the stack
+					target = IsJumpIfTrue(op) == IsJumpIfTrue(opNext) ? next.arg0 : target + 1;
+				else break;
+			}
+			return target;
+		};
+		for (code& iCode : codes) {
+			if (!IsJump(iCode.GetOp()) || iCode.arg0 >= countCode) continue;
+			iCode.arg0 = GetThreadedTarget(iCode.GetOp(), iCode.arg0);
+		}
+
+		//Only code reachable from the start of the block is kept
+		std::vector<bool> listReachable(countCode + 1U, false);
+		{
+			std::vector<size_t> listPending = { 0U };
+			while (listPending.size() > 0U) {
+				size_t ip = listPending.back();
+				listPending.pop_back();
+				if (ip >= countCode || listReachable[ip]) continue;
+				listReachable[ip] = true;
+
+				const code& c = codes[ip];
+				command_kind op = c.GetOp();
+				if (IsJump(op))
+					listPending.push_back(c.arg0);
+				if (op != command_kind::pc_jump && op != command_kind::pc_sub_return)
+					listPending.push_back(ip + 1);
+			}
+		}
+
+		//Jumps to the next kept instruction are dropped, merging the blocks on either side of them
+		std::vector<bool> listKeep(countCode, false);
+		std::vector<size_t> listNextKept(countCode + 1U);	//First kept instruction at or after each ip
+		listNextKept[countCode] = countCode;
+		for (size_t ip = countCode; ip-- > 0;) {
+			const code& c = codes[ip];
+			bool bKeep = listReachable[ip] && c.GetOp() != command_kind::pc_nop;
+			if (bKeep && c.GetOp() == command_kind::pc_jump && c.arg0 > ip
+				&& listNextKept[c.arg0] == listNextKept[ip + 1])
+			{
+				bKeep = false;
+			}
+			listKeep[ip] = bKeep;
+			listNextKept[ip] = bKeep ? ip : listNextKept[ip + 1];
+		}
+
+		std::vector<code> newCodes;
+		newCodes.reserve(countCode);
+		std::vector<size_t> mapIp(countCode + 1U);
+		for (size_t ip = 0; ip < countCode; ++ip) {
+			mapIp[ip] = newCodes.size();
+			if (listKeep[ip])
+				newCodes.push_back(codes[ip]);
+		}
+		mapIp[countCode] = newCodes.size();
+		if (newCodes.size() == countCode) break;
+
+		for (code& iCode : newCodes) {
+			if (IsJump(iCode.GetOp()))
+				iCode.arg0 = mapIp[iCode.arg0];
+		}
+		codes = newCodes;
+	}
+}
+
 void parser::scan_final(script_block* block, parser_state_t* state) {
 	for (auto itr = block->codes.begin(); itr != block->codes.end(); ++itr) {
 		parser_assert(itr->GetLine(), itr->GetOp() != command_kind::pc_loop_break,
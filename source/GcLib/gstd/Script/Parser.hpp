@@ -102,8 +102,54 @@ namespace gstd {
 		pc_inline_cast_var,			//Cast {esp-0} to (type_data*)[arg0], check type conversion if [arg1]
 		pc_inline_index_array,		//Push &((*{esp-1})[{esp-0}]) to stack
 		pc_inline_index_array2,		//Push ({esp-1}[{esp-0}]) to stack
+		pc_inline_set_array,		//Set (*{esp-2})[{esp-1}] to {esp-0}
 		pc_inline_length_array,		//Push length({esp-0}) to stack
 
+		//------------------------------------------------------------------------
+		//Typed inline operations, emitted when both operands are known to be int or float
+		//Fall back to the untyped operation if the operands don't hold the expected types
+		//------------------------------------------------------------------------
+		pc_inline_add_int,		//Push ({esp-1} + {esp-0}) to stack, both int
+		pc_inline_sub_int,		//Push ({esp-1} - {esp-0}) to stack, both int
+		pc_inline_mul_int,		//Push ({esp-1} * {esp-0}) to stack, both int
+		pc_inline_fdiv_int,		//Push ({esp-1} ~/ {esp-0}) to stack, both int
+		pc_inline_mod_int,		//Push ({esp-1} % {esp-0}) to stack, both int
+		pc_inline_add_float,	//Push ({esp-1} + {esp-0}) to stack, int or float
+		pc_inline_sub_float,	//Push ({esp-1} - {esp-0}) to stack, int or float
+		pc_inline_mul_float,	//Push ({esp-1} * {esp-0}) to stack, int or float
+		pc_inline_div_float,	//Push ({esp-1} / {esp-0}) to stack, int or float
+		pc_inline_fdiv_float,	//Push ({esp-1} ~/ {esp-0}) to stack, int or float
+		pc_inline_mod_float,	//Push ({esp-1} % {esp-0}) to stack, int or float
+		pc_inline_cmp_int,		//Push ({esp-1} cmp {esp-0}) to stack, both int, cmp=(command_kind)[arg0]
+		pc_inline_cmp_float,	//Push ({esp-1} cmp {esp-0}) to stack, int or float, cmp=(command_kind)[arg0]
+
+		//------------------------------------------------------------------------
+		//Intrinsics, emitted in place of calls to builtins registered with one
+		//Take [arg0] values from the stack, and push the float result
+		//------------------------------------------------------------------------
+		pc_inline_sin,			//Push sin({esp-0}) to stack, in degrees
+		pc_inline_cos,			//Push cos({esp-0}) to stack, in degrees
+		pc_inline_rsin,			//Push sin({esp-0}) to stack, in radians
+		pc_inline_rcos,			//Push cos({esp-0}) to stack, in radians
+		pc_inline_atan2,		//Push atan2({esp-1}, {esp-0}) to stack, in degrees
+		pc_inline_ratan2,		//Push atan2({esp-1}, {esp-0}) to stack, in radians
+		pc_inline_sqrt,			//Push sqrt({esp-0}) to stack
+		pc_inline_hypot,		//Push hypot({esp-1}, {esp-0}) to stack
+		pc_inline_distance,		//Push hypot({esp-1} - {esp-3}, {esp-0} - {esp-2}) to stack
+		pc_inline_trunc,		//Push trunc({esp-0}) to stack
+
+		//------------------------------------------------------------------------
+		//Superinstructions, only emitted by parser::optimize_peephole
+		//Operands are the pc_push_value/pc_push_variable codes that follow, which are skipped over
+		//------------------------------------------------------------------------
+		pc_loop_count_jump,		//pc_loop_count, but jump to [arg0] instead of pushing false
+		pc_loop_ascent_jump,	//pc_loop_ascent, but jump to [arg0] instead of pushing true
+		pc_loop_descent_jump,	//pc_loop_descent, but jump to [arg0] instead of pushing true
+		pc_cmp_jump,			//Jump to [arg0] if (operand0 cmp operand1) == (([arg1] >> 8) & 1), cmp=(command_kind)([arg1] & 0xff)
+								//	Typed by (command_kind)([arg1] >> 16) if nonzero
+		pc_op_assign,			//Copy (operand0 op operand1) to variable=[arg1], op=(command_kind)[arg0]
+		pc_op_asi,				//(variable=[arg1]) op= operand0, op=(command_kind)[arg0]
+
 		pc_nop = 0xff,			//No operation
 	};
 	enum class block_kind : uint8_t {
@@ -116,6 +162,7 @@ namespace gstd {
 		uint32_t arguments;
 		std::string name;
 		dnh_func_callback_t func;
+		command_kind intrinsic;
 		std::vector<code> codes;
 		block_kind kind;
 
@@ -188,10 +235,12 @@ namespace gstd {
 			size_t ip;
 			size_t var_count_main;
 			size_t var_count_sub;
+			type_data* expr_type;	//Type of the last parsed expression, nullptr if not known
 
 			parser_state_t() : state_pred(nullptr), lex(nullptr), ip(0) {
 				var_count_main = 0;
 				var_count_sub = 0;
+				expr_type = nullptr;
 			}
 			parser_state_t(script_scanner* _lex) : parser_state_t() {
 				lex = _lex;
@@ -280,9 +329,12 @@ namespace gstd {
 		parser(script_engine* e, script_scanner* s);
 		virtual ~parser() {}
 
+		static const std::vector<function>* get_base_operations();
+
 		void load_functions(std::vector<function>* list_func);
 		void load_constants(std::vector<constant>* list_const);
 		void begin_parse();
+		void optimize_peephole();
 
 		void parse_parentheses(script_block* block, parser_state_t* state);
 		void parse_clause(script_block* block, parser_state_t* state);
@@ -325,6 +377,8 @@ namespace gstd {
 		void write_operation(script_block* block, parser_state_t* state, const symbol* s, int clauses);
 
 		void optimize_expression(script_block* block, parser_state_t* state);
+		void optimize_control_flow(script_block* block);
+		void fuse_superinstructions(script_block* block);
 		void link_jump(script_block* block, parser_state_t* state, size_t ip_off);
 		void link_break_continue(script_block* block, parser_state_t* state, 
 			size_t ip_begin, size_t ip_end, size_t ip_break, size_t ip_continue);
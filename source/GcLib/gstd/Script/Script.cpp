@@ -37,12 +37,16 @@ script_type_manager::script_type_manager() {
 }
 
 type_data* script_type_manager::get_type(type_data* type) {
-	auto itr = types.find(*type);
-	if (itr == types.end()) {
-		//No type found, insert and return the new type
-		itr = types.insert(*type).first;
+	{
+		std::shared_lock<std::shared_mutex> lock(mtx_types);
+		auto itr = types.find(*type);
+		if (itr != types.end())
+			return deref_itr(itr);
 	}
-	return deref_itr(itr);
+
+	//No type found, insert and return the new type
+	std::unique_lock<std::shared_mutex> lock(mtx_types);
+	return deref_itr(types.insert(*type).first);
 }
 type_data* script_type_manager::get_type(type_data::type_kind kind) {
 	type_data target = type_data(kind);
@@ -56,22 +60,37 @@ type_data* script_type_manager::get_array_type(type_data* element) {
 //****************************************************************************
 //script_engine
 //****************************************************************************
-script_engine::script_engine(const std::wstring& source, std::vector<function>* list_func, std::vector<constant>* list_const) {
-	init(source.data(), source.data() + source.size(), list_func, list_const);
+script_engine::script_engine() {
+	data = nullptr;
+	main_block = nullptr;
+
+	error = false;
+	error_line = 0;
 }
-script_engine::script_engine(const std::vector<char>& source, std::vector<function>* list_func, std::vector<constant>* list_const) {
+script_engine::script_engine(const std::wstring& source, std::vector<function>* list_func, std::vector<constant>* list_const,
+	bool peephole)
+{
+	init(source.data(), source.data() + source.size(), list_func, list_const, peephole);
+}
+script_engine::script_engine(const std::vector<char>& source, std::vector<function>* list_func, std::vector<constant>* list_const,
+	bool peephole)
+{
 	const char* begin = source.data();
 	const char* end = begin + source.size();
-	init((wchar_t*)begin, (wchar_t*)end, list_func, list_const);
+	init((wchar_t*)begin, (wchar_t*)end, list_func, list_const, peephole);
 }
-script_engine::script_engine(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const) {
-	init(source, end, list_func, list_const);
+script_engine::script_engine(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const,
+	bool peephole)
+{
+	init(source, end, list_func, list_const, peephole);
 }
 script_engine::~script_engine() {
 	blocks.clear();
 }
 
-void script_engine::init(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const) {
+void script_engine::init(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const,
+	bool peephole)
+{
 	main_block = new_block(1, block_kind::bk_normal);
 
 	data = nullptr;
@@ -82,8 +101,11 @@ void script_engine::init(const wchar_t* source, const wchar_t* end, std::vector<
 	if (list_func) p.load_functions(list_func);
 	if (list_const) p.load_constants(list_const);
 	p.begin_parse();
+	if (peephole && !p.error)
+		p.optimize_peephole();
 
 	events = p.events;
+	build_event_table();
 
 	error = p.error;
 	error_message = p.error_message;
@@ -95,6 +117,517 @@ script_block* script_engine::new_block(int level, block_kind kind) {
 	return &*blocks.insert(blocks.end(), x);
 }
 
+static std::mutex _event_id_lock;
+static std::unordered_map<std::string, uint32_t> _event_ids = {
+	{ "Initialize", script_engine::EVENT_INITIALIZE },
+	{ "MainLoop", script_engine::EVENT_MAIN_LOOP },
+	{ "Event", script_engine::EVENT_EVENT },
+	{ "Finalize", script_engine::EVENT_FINALIZE },
+	{ "Loading", script_engine::EVENT_LOADING },
+};
+uint32_t script_engine::get_event_id(const std::string& name) {
+	//Scripts get compiled in the load thread too
+	std::lock_guard<std::mutex> lock(_event_id_lock);
+
+	auto itrFind = _event_ids.find(name);
+	if (itrFind != _event_ids.end())
+		return itrFind->second;
+
+	uint32_t id = _event_ids.size();
+	_event_ids[name] = id;
+	return id;
+}
+void script_engine::build_event_table() {
+	event_table.clear();
+	for (auto& [name, block] : events) {
+		uint32_t id = get_event_id(name);
+		if (id >= event_table.size())
+			event_table.resize(id + 1, nullptr);
+		event_table[id] = block;
+	}
+}
+
+//----------------------------------------------------------------------------
+//Bytecode cache
+//	Blocks are written in list order and referenced by index
+//	Native function blocks only store their name and argc, and are bound to the callbacks again on load
+//----------------------------------------------------------------------------
+namespace {
+	class bytecode_writer {
+		std::vector<char>* dst_;
+	public:
+		bytecode_writer(std::vector<char>* dst) : dst_(dst) {}
+
+		template<typename T> void write(T data) {
+			const char* p = (const char*)&data;
+			dst_->insert(dst_->end(), p, p + sizeof(T));
+		}
+		void write_string(const std::string& str) {
+			write<uint32_t>(str.size());
+			dst_->insert(dst_->end(), str.begin(), str.end());
+		}
+	};
+	class bytecode_reader {
+		const char* pos_;
+		const char* end_;
+	public:
+		bool error = false;
+
+		bytecode_reader(const std::vector<char>& src) : pos_(src.data()), end_(src.data() + src.size()) {}
+
+		size_t remaining() const { return end_ - pos_; }
+
+		template<typename T> T read() {
+			T res = T();
+			if (remaining() < sizeof(T)) {
+				error = true;
+				pos_ = end_;
+				return res;
+			}
+			memcpy(&res, pos_, sizeof(T));
+			pos_ += sizeof(T);
+			return res;
+		}
+		std::string read_string() {
+			size_t size = read<uint32_t>();
+			if (remaining() < size) {
+				error = true;
+				pos_ = end_;
+				return "";
+			}
+			std::string res(pos_, size);
+			pos_ += size;
+			return res;
+		}
+	};
+}
+
+//Function references are ints holding a block pointer, tagged with 0x6a53 in the upper 16 bits
+static constexpr uint8_t BYTECODE_TYPE_NONE = 0xff;
+static constexpr uint8_t BYTECODE_FUNC_REF = 0xfe;
+static constexpr size_t BYTECODE_MAX_DEPTH = 64;
+
+static bool _bytecode_write_type(bytecode_writer& w, type_data* type) {
+	if (type == nullptr) {
+		w.write<uint8_t>(BYTECODE_TYPE_NONE);
+		return true;
+	}
+	type_data::type_kind kind = type->get_kind();
+	switch (kind) {
+	case type_data::tk_null:
+	case type_data::tk_int:
+	case type_data::tk_float:
+	case type_data::tk_char:
+	case type_data::tk_boolean:
+		w.write<uint8_t>(kind);
+		return true;
+	case type_data::tk_array:
+		w.write<uint8_t>(kind);
+		return _bytecode_write_type(w, type->get_element());
+	}
+	return false;
+}
+static bool _bytecode_read_type(bytecode_reader& r, uint8_t kind, type_data** pType, size_t depth) {
+	script_type_manager* typeManager = script_type_manager::get_instance();
+
+	switch (kind) {
+	case BYTECODE_TYPE_NONE:
+		*pType = nullptr;
+		return !r.error;
+	case type_data::tk_null:
+	case type_data::tk_int:
+	case type_data::tk_float:
+	case type_data::tk_char:
+	case type_data::tk_boolean:
+		*pType = typeManager->get_type((type_data::type_kind)kind);
+		return !r.error;
+	case type_data::tk_array:
+	{
+		type_data* elem = nullptr;
+		if (depth >= BYTECODE_MAX_DEPTH || !_bytecode_read_type(r, r.read<uint8_t>(), &elem, depth + 1))
+			return false;
+		*pType = typeManager->get_array_type(elem);
+		return true;
+	}
+	}
+	return false;
+}
+
+static bool _bytecode_write_value(bytecode_writer& w, const value& val,
+	const std::unordered_map<script_block*, uint32_t>& mapIndex)
+{
+	type_data* type = val.get_type();
+	if (type && type->get_kind() == type_data::tk_int) {
+		uint64_t raw = (uint64_t)val.as_int();
+		if ((raw >> 48) == 0x6a53) {
+			auto itr = mapIndex.find((script_block*)(raw & 0xffffffff));
+			if (itr != mapIndex.end()) {
+				w.write<uint8_t>(BYTECODE_FUNC_REF);
+				w.write<uint32_t>(itr->second);
+				w.write<uint32_t>(raw >> 32);
+				return true;
+			}
+		}
+	}
+
+	if (!_bytecode_write_type(w, type)) return false;
+	if (type == nullptr) return true;
+
+	switch (type->get_kind()) {
+	case type_data::tk_int:
+		w.write<int64_t>(val.as_int());
+		break;
+	case type_data::tk_float:
+		w.write<double>(val.as_float());
+		break;
+	case type_data::tk_char:
+		w.write<uint32_t>(val.as_char());
+		break;
+	case type_data::tk_boolean:
+		w.write<uint8_t>(val.as_boolean());
+		break;
+	case type_data::tk_array:
+	{
+		size_t length = val.length_as_array();
+		w.write<uint32_t>(length);
+		for (size_t i = 0; i < length; ++i) {
+			if (!_bytecode_write_value(w, val.get_element_as_array(i), mapIndex))
+				return false;
+		}
+		break;
+	}
+	}
+	return true;
+}
+static bool _bytecode_read_value(bytecode_reader& r, value* val,
+	const std::vector<script_block*>& listBlock, size_t depth)
+{
+	if (depth >= BYTECODE_MAX_DEPTH) return false;
+
+	uint8_t tag = r.read<uint8_t>();
+	if (tag == BYTECODE_FUNC_REF) {
+		uint32_t index = r.read<uint32_t>();
+		uint64_t upper = r.read<uint32_t>();
+		if (r.error || index >= listBlock.size()) return false;
+
+		uint64_t raw = (upper << 32) | ((uint64_t)listBlock[index] & 0xffffffff);
+		val->reset(script_type_manager::get_int_type(), (int64_t)raw);
+		return true;
+	}
+
+	type_data* type = nullptr;
+	if (!_bytecode_read_type(r, tag, &type, depth)) return false;
+	if (type == nullptr) {
+		*val = value();
+		return true;
+	}
+
+	switch (type->get_kind()) {
+	case type_data::tk_null:
+		*val = value();
+		val->set(type);
+		break;
+	case type_data::tk_int:
+		val->reset(type, r.read<int64_t>());
+		break;
+	case type_data::tk_float:
+		val->reset(type, r.read<double>());
+		break;
+	case type_data::tk_char:
+		val->reset(type, (wchar_t)r.read<uint32_t>());
+		break;
+	case type_data::tk_boolean:
+		val->reset(type, r.read<uint8_t>() != 0);
+		break;
+	case type_data::tk_array:
+	{
+		size_t length = r.read<uint32_t>();
+		if (length > r.remaining()) return false;
+
+		std::vector<value> listElem(length);
+		for (size_t i = 0; i < length; ++i) {
+			if (!_bytecode_read_value(r, &listElem[i], listBlock, depth + 1))
+				return false;
+		}
+		val->reset(type, listElem);
+		break;
+	}
+	}
+	return !r.error;
+}
+
+static bool _bytecode_write_code(bytecode_writer& w, const code& c,
+	const std::unordered_map<script_block*, uint32_t>& mapIndex)
+{
+	command_kind op = c.GetOp();
+	w.write<uint8_t>((uint8_t)op);
+	w.write<uint32_t>(c.GetLine());
+#ifdef _DEBUG
+	w.write_string(c.var_name);
+#endif
+
+	switch (op) {
+	case command_kind::pc_push_value:
+		return _bytecode_write_value(w, c.data, mapIndex);
+	case command_kind::pc_call:
+	case command_kind::pc_call_and_push_result:
+	{
+		auto itr = mapIndex.find(c.block);
+		if (itr == mapIndex.end()) return false;
+		w.write<uint32_t>(itr->second);
+		break;
+	}
+	case command_kind::pc_inline_cast_var:
+		if (!_bytecode_write_type(w, (type_data*)c.arg0)) return false;
+		break;
+	default:
+		w.write<uint64_t>(c.arg0);
+		break;
+	}
+	w.write<uint32_t>(c.arg1);
+	return true;
+}
+static bool _bytecode_read_code(bytecode_reader& r, script_block* block,
+	const std::vector<script_block*>& listBlock)
+{
+	command_kind op = (command_kind)r.read<uint8_t>();
+	uint32_t line = r.read<uint32_t>();
+#ifdef _DEBUG
+	std::string name = r.read_string();
+#else
+	std::string name;
+#endif
+	if (op > command_kind::pc_op_asi && op != command_kind::pc_nop)
+		return false;
+
+	if (op == command_kind::pc_push_value) {
+		value val;
+		if (!_bytecode_read_value(r, &val, listBlock, 0)) return false;
+		block->codes.push_back(code(line, op, val));
+		return true;
+	}
+
+	code c(op, 0, 0, name);
+	c.SetLine(line);
+	switch (op) {
+	case command_kind::pc_call:
+	case command_kind::pc_call_and_push_result:
+	{
+		uint32_t index = r.read<uint32_t>();
+		if (index >= listBlock.size()) return false;
+		c.block = listBlock[index];
+		break;
+	}
+	case command_kind::pc_inline_cast_var:
+	{
+		type_data* type = nullptr;
+		if (!_bytecode_read_type(r, r.read<uint8_t>(), &type, 0)) return false;
+		c.arg0 = (uint32_t)type;
+		break;
+	}
+	default:
+		c.arg0 = (decltype(c.arg0))r.read<uint64_t>();
+		break;
+	}
+	c.arg1 = r.read<uint32_t>();
+	block->codes.push_back(c);
+	return !r.error;
+}
+//Checks what run_code trusts the parser for: jump targets, operand codes of superinstructions and variable levels
+//	Variable indices are checked when they are accessed, stack depths aren't checked at all
+static bool _bytecode_check_block(const script_block* block) {
+	const std::vector<code>& codes = block->codes;
+	size_t countCode = codes.size();
+
+	//Levels packed into arg1 take its upper 12 bits
+	auto IsVariableLevelValid = [&](uint32_t level) { return level <= block->level; };
+	auto IsOperand = [](const code& c) {
+		return c.GetOp() == command_kind::pc_push_value || c.GetOp() == command_kind::pc_push_variable;
+	};
+
+	for (size_t ip = 0; ip < countCode; ++ip) {
+		const code& c = codes[ip];
+		size_t countOperand = 0;
+
+		switch (c.GetOp()) {
+		case command_kind::pc_jump_target:
+		case command_kind::_pc_jump:
+		case command_kind::_pc_jump_if:
+		case command_kind::_pc_jump_if_not:
+		case command_kind::_pc_jump_if_nopop:
+		case command_kind::_pc_jump_if_not_nopop:
+		case command_kind::pc_loop_continue:
+		case command_kind::pc_loop_break:
+			return false;	//Parser dummies, never left in linked code
+		case command_kind::pc_jump:
+		case command_kind::pc_jump_if:
+		case command_kind::pc_jump_if_not:
+		case command_kind::pc_jump_if_nopop:
+		case command_kind::pc_jump_if_not_nopop:
+		case command_kind::pc_loop_count_jump:
+		case command_kind::pc_loop_ascent_jump:
+		case command_kind::pc_loop_descent_jump:
+			if (c.arg0 > countCode) return false;
+			break;
+		case command_kind::pc_cmp_jump:
+			if (c.arg0 > countCode) return false;
+			countOperand = 2;
+			break;
+		case command_kind::pc_push_variable:
+		case command_kind::pc_push_variable2:
+		case command_kind::pc_copy_assign:
+			if (!IsVariableLevelValid(c.arg0)) return false;
+			break;
+		case command_kind::pc_inline_inc:
+		case command_kind::pc_inline_dec:
+		case command_kind::pc_inline_add_asi:
+		case command_kind::pc_inline_sub_asi:
+		case command_kind::pc_inline_mul_asi:
+		case command_kind::pc_inline_div_asi:
+		case command_kind::pc_inline_fdiv_asi:
+		case command_kind::pc_inline_mod_asi:
+		case command_kind::pc_inline_pow_asi:
+		case command_kind::pc_inline_cat_asi:
+			if (c.arg0 && !IsVariableLevelValid(c.arg1 >> 20)) return false;
+			break;
+		case command_kind::pc_op_assign:
+		case command_kind::pc_op_asi:
+			if (!IsVariableLevelValid(c.arg1 >> 20)) return false;
+			countOperand = c.GetOp() == command_kind::pc_op_assign ? 2 : 1;
+			break;
+		}
+
+		if (countOperand > 0) {
+			if (ip + countOperand >= countCode) return false;
+			for (size_t i = 1; i <= countOperand; ++i) {
+				const code& operand = codes[ip + i];
+				if (!IsOperand(operand)) return false;
+				if (operand.GetOp() == command_kind::pc_push_variable && !IsVariableLevelValid(operand.arg0))
+					return false;
+			}
+		}
+	}
+	return true;
+}
+
+bool script_engine::save_bytecode(std::vector<char>& dst) {
+	if (error) return false;
+
+	std::unordered_map<script_block*, uint32_t> mapIndex;
+	for (script_block& iBlock : blocks) {
+		uint32_t index = mapIndex.size();
+		mapIndex[&iBlock] = index;
+	}
+
+	bytecode_writer w(&dst);
+	//Catches opcode table changes made without bumping BYTECODE_VERSION
+	w.write<uint8_t>((uint8_t)command_kind::pc_op_asi);
+#ifdef _DEBUG
+	w.write<uint8_t>(1);
+#else
+	w.write<uint8_t>(0);
+#endif
+
+	w.write<uint32_t>(blocks.size());
+	w.write<uint32_t>(mapIndex[main_block]);
+	for (script_block& iBlock : blocks) {
+		w.write<uint32_t>(iBlock.level);
+		w.write<uint32_t>(iBlock.arguments);
+		w.write<uint8_t>((uint8_t)iBlock.kind);
+		w.write_string(iBlock.name);
+		w.write<uint8_t>(iBlock.func != nullptr);
+		if (iBlock.func) continue;
+
+		w.write<uint32_t>(iBlock.codes.size());
+		for (code& iCode : iBlock.codes) {
+			if (!_bytecode_write_code(w, iCode, mapIndex))
+				return false;
+		}
+	}
+
+	w.write<uint32_t>(events.size());
+	for (auto& [name, block] : events) {
+		w.write_string(name);
+		w.write<uint32_t>(mapIndex[block]);
+	}
+	return true;
+}
+bool script_engine::load_bytecode(const std::vector<char>& src, std::vector<function>* list_func) {
+	std::map<std::pair<std::string, uint32_t>, const function*> mapNative;
+	for (const function& iFunc : *parser::get_base_operations())
+		mapNative[std::make_pair(std::string(iFunc.name), (uint32_t)iFunc.argc)] = &iFunc;
+	if (list_func) {
+		for (const function& iFunc : *list_func)
+			mapNative[std::make_pair(std::string(iFunc.name), (uint32_t)iFunc.argc)] = &iFunc;
+	}
+
+	blocks.clear();
+	events.clear();
+	main_block = nullptr;
+
+	bytecode_reader r(src);
+	if (r.read<uint8_t>() != (uint8_t)command_kind::pc_op_asi) return false;
+#ifdef _DEBUG
+	if (r.read<uint8_t>() != 1) return false;
+#else
+	if (r.read<uint8_t>() != 0) return false;
+#endif
+
+	size_t countBlock = r.read<uint32_t>();
+	size_t indexMain = r.read<uint32_t>();
+	if (r.error || countBlock > r.remaining() || indexMain >= countBlock) return false;
+
+	//Allocate every block first, calls can refer forward
+	std::vector<script_block*> listBlock(countBlock);
+	for (size_t i = 0; i < countBlock; ++i)
+		listBlock[i] = new_block(0, block_kind::bk_normal);
+	main_block = listBlock[indexMain];
+
+	for (script_block* block : listBlock) {
+		block->level = r.read<uint32_t>();
+		block->arguments = r.read<uint32_t>();
+		block->kind = (block_kind)r.read<uint8_t>();
+		block->name = r.read_string();
+
+		bool bNative = r.read<uint8_t>() != 0;
+		if (r.error) return false;
+
+		//A block can't be nested deeper than there are blocks
+		if (block->kind > block_kind::bk_microthread || block->level >= countBlock) return false;
+		if (bNative) {
+			auto itrFind = mapNative.find(std::make_pair(block->name, block->arguments));
+			if (itrFind == mapNative.end()) return false;
+			block->func = itrFind->second->func;
+			block->intrinsic = itrFind->second->intrinsic;
+			continue;
+		}
+
+		size_t countCode = r.read<uint32_t>();
+		if (r.error || countCode > r.remaining()) return false;
+		block->codes.reserve(countCode);
+		for (size_t i = 0; i < countCode; ++i) {
+			if (!_bytecode_read_code(r, block, listBlock))
+				return false;
+		}
+		if (!_bytecode_check_block(block)) return false;
+	}
+
+	size_t countEvent = r.read<uint32_t>();
+	if (r.error || countEvent > r.remaining()) return false;
+	for (size_t i = 0; i < countEvent; ++i) {
+		std::string name = r.read_string();
+		size_t index = r.read<uint32_t>();
+		if (r.error || index >= countBlock) return false;
+		events[name] = listBlock[index];
+	}
+	build_event_table();
+
+	error = false;
+	error_message = L"";
+	error_line = 0;
+	return r.remaining() == 0;
+}
+
 //****************************************************************************
 //script_machine::environment
 //****************************************************************************
@@ -123,6 +656,15 @@ void script_machine::environment::init(environment* parent, script_block* b) {
 	has_result = false;
 	waitCount = 0;
 
+	//Same result as walking up the parent chain for a level, done once here instead of on every access
+	if (parent)
+		display = parent->display;
+	else
+		display.clear();
+	if (display.size() <= b->level)
+		display.resize(b->level + 1U, nullptr);
+	display[b->level] = this;
+
 	if (parent)
 		parent->add_ref();
 	_ref = 1;
@@ -147,6 +689,16 @@ void script_machine::environment::dec_ref() {
 script_machine::script_machine(script_engine* the_engine) {
 	engine = the_engine;
 
+	profiler = nullptr;
+	profile_countdown = 0;
+
+	instruction_count = 0;
+	instruction_budget = 0;
+	budget_yield = false;
+	budget_callback = nullptr;
+
+	call_gate = nullptr;
+
 	reset();
 }
 script_machine::~script_machine() {
@@ -174,8 +726,23 @@ script_machine::environment* script_machine::get_new_environment() {
 	return res;
 }
 void script_machine::dispose_environment(environment* env) {
+	//Its variables are already gone, arrays still pinned from here stay pinned
+	if (pinned_arrays.size() > 0) {
+		auto itrEnd = std::remove_if(pinned_arrays.begin(), pinned_arrays.end(),
+			[&](const pinned_array& pin) { return pin.stack == &env->stack; });
+		pinned_arrays.erase(itrEnd, pinned_arrays.end());
+	}
 	_list_free_environments.push_back(env);
 }
+//Unpins the arrays whose element reference has been popped off the stack
+void script_machine::release_pinned_arrays(const script_value_vector* stack) {
+	for (size_t i = pinned_arrays.size(); i-- > 0;) {
+		const pinned_array& pin = pinned_arrays[i];
+		if (pin.stack != stack || pin.depth < stack->size()) continue;
+		pin.arr->unpin();
+		pinned_arrays.erase(pinned_arrays.begin() + i);
+	}
+}
 
 bool script_machine::has_event(const std::string& event_name, std::map<std::string, script_block*>::iterator& res) {
 	res = engine->events.find(event_name);
@@ -203,7 +770,16 @@ void script_machine::reset() {
 
 	list_parent_environment.clear();
 	threads.clear();
-	current_thread_index = std::list<environment*>::iterator();
+	current_thread_index = std::list<microthread>::iterator();
+
+	sweep_count = 0;
+	sweep_nested = 0;
+	sleeping_threads.clear();
+	thread_orders.clear();
+
+	pinned_arrays.clear();
+
+	reset_instruction_count();
 }
 void script_machine::run() {
 	if (bTerminate) return;
@@ -213,7 +789,7 @@ void script_machine::run() {
 
 		environment* mainEnv = get_new_environment();
 		mainEnv->init(nullptr, engine->main_block);
-		threads.push_back(mainEnv);
+		threads.push_back({ mainEnv, 0 });
 
 		current_thread_index = threads.begin();
 
@@ -240,10 +816,33 @@ void script_machine::call(const std::string& event_name) {
 void script_machine::call(std::map<std::string, script_block*>::iterator event_itr) {
 	if (bTerminate) return;
 
-	if (event_itr != engine->events.end()) {
-		run();
-		interrupt(event_itr->second);
-	}
+	if (event_itr != engine->events.end())
+		call(event_itr->second);
+}
+void script_machine::call(script_block* event) {
+	if (bTerminate || event == nullptr) return;
+
+	run();
+	interrupt(event);
+}
+
+void script_machine::set_profiler(script_profiler* p) {
+	profiler = p;
+	profile_countdown = p ? p->interval : 0;
+}
+
+//Budget of instructions between reset_instruction_count calls, normally a frame
+void script_machine::set_instruction_budget(uint64_t budget, bool bYield) {
+	instruction_budget = budget;
+	budget_yield = bYield;
+	instruction_limit = budget > 0 ? budget : UINT64_MAX;
+}
+uint64_t script_machine::reset_instruction_count() {
+	uint64_t res = instruction_count;
+	instruction_count = 0;
+	instruction_limit = instruction_budget > 0 ? instruction_budget : UINT64_MAX;
+	budget_overrun = false;
+	return res;
 }
 
 void script_machine::interrupt(script_block* sub) {
@@ -251,11 +850,16 @@ void script_machine::interrupt(script_block* sub) {
 	auto prev_thread = current_thread_index;
 	current_thread_index = threads.begin();
 
-	environment* env_first = *current_thread_index;
+	//Threads between the saved one and the list head get visited again once it resumes,
+	//	so sweeps done by the event can't be counted with sweep_count alone
+	bool bNested = prev_thread != threads.begin();
+	if (bNested) ++sweep_nested;
+
+	environment* env_first = current_thread_index->env;
 
 	environment* new_env = get_new_environment();
 	new_env->init(env_first, sub);
-	*current_thread_index = new_env;
+	current_thread_index->env = new_env;
 
 	finished = false;
 
@@ -264,36 +868,131 @@ void script_machine::interrupt(script_block* sub) {
 	list_parent_environment.pop_back();
 
 	finished = false;
+	if (bNested) --sweep_nested;
 
 	//Resume previous thread
 	current_thread_index = prev_thread;
 }
 script_machine::environment* script_machine::add_thread(script_block* sub) {
 	environment* e = get_new_environment();
-	e->init(*current_thread_index, sub);
+	e->init(current_thread_index->env, sub);
 
-	threads.insert(++current_thread_index, e);
-	--current_thread_index;
+	uint64_t order = get_new_thread_order();
+	//The new thread runs right away, then yields back to this one
+	current_thread_index = threads.insert(std::next(current_thread_index), { e, order });
 
 	return e;
 }
 script_machine::environment* script_machine::add_child_block(script_block* sub) {
 	environment* e = get_new_environment();
-	e->init(*current_thread_index, sub);
+	e->init(current_thread_index->env, sub);
 
-	*current_thread_index = e;
+	current_thread_index->env = e;
 
 	return e;
 }
 
+//Orders are spaced out so a thread can be placed right after the current one without touching the rest,
+//	and a sleeping thread keeps its order to find its place again when it wakes
+uint64_t script_machine::get_new_thread_order() {
+	constexpr uint64_t ORDER_END = UINT64_MAX;
+
+	uint64_t prev = current_thread_index->order;
+	auto itrNext = thread_orders.upper_bound(prev);
+	uint64_t next = itrNext != thread_orders.end() ? *itrNext : ORDER_END;
+
+	if (next - prev < 2) {
+		relabel_threads();
+		prev = current_thread_index->order;
+		itrNext = thread_orders.upper_bound(prev);
+		next = itrNext != thread_orders.end() ? *itrNext : ORDER_END;
+	}
+
+	uint64_t res = prev + (next - prev) / 2;
+	thread_orders.insert(res);
+	return res;
+}
+void script_machine::relabel_threads() {
+	std::vector<uint64_t*> listOrder;
+	listOrder.reserve(threads.size() + sleeping_threads.size());
+	for (auto itr = std::next(threads.begin()); itr != threads.end(); ++itr)
+		listOrder.push_back(&itr->order);
+	for (sleeping_thread& iSleep : sleeping_threads)
+		listOrder.push_back(&iSleep.thread.order);
+	std::sort(listOrder.begin(), listOrder.end(),
+		[](uint64_t* a, uint64_t* b) { return *a < *b; });
+
+	//Relative order is unchanged, so the heap (keyed on wake) stays valid
+	uint64_t step = UINT64_MAX / (listOrder.size() + 2);
+	thread_orders.clear();
+	for (size_t i = 0; i < listOrder.size(); ++i) {
+		*listOrder[i] = step * (i + 1);
+		thread_orders.insert(thread_orders.end(), *listOrder[i]);
+	}
+}
+void script_machine::sleep_thread() {
+	//Would be visited waitCount more times before running again
+	sleeping_threads.push_back({ sweep_count + current_thread_index->env->waitCount + 1, *current_thread_index });
+	std::push_heap(sleeping_threads.begin(), sleeping_threads.end(), std::greater<sleeping_thread>());
+
+	current_thread_index = threads.erase(current_thread_index);
+}
+void script_machine::wake_threads(bool bAll) {
+	std::vector<microthread> listWake;
+	if (bAll) {
+		//Back to counting down in the list, waitCount being what it would have been by the next sweep
+		for (sleeping_thread& iSleep : sleeping_threads) {
+			iSleep.thread.env->waitCount = (int)(iSleep.wake - sweep_count - 1);
+			listWake.push_back(iSleep.thread);
+		}
+		sleeping_threads.clear();
+	}
+	else {
+		while (sleeping_threads.size() > 0 && sleeping_threads.front().wake <= sweep_count) {
+			std::pop_heap(sleeping_threads.begin(), sleeping_threads.end(), std::greater<sleeping_thread>());
+			sleeping_threads.back().thread.env->waitCount = 0;
+			listWake.push_back(sleeping_threads.back().thread);
+			sleeping_threads.pop_back();
+		}
+	}
+	std::sort(listWake.begin(), listWake.end(),
+		[](const microthread& a, const microthread& b) { return a.order < b.order; });
+
+	//Merge back into the list by order
+	auto itr = std::next(threads.begin());
+	for (microthread& iThread : listWake) {
+		while (itr != threads.end() && itr->order < iThread.order)
+			++itr;
+		threads.insert(itr, iThread);
+	}
+}
+
+static inline type_data::type_kind _get_value_kind(const value* v) {
+	return v->has_data() ? v->get_type()->get_kind() : type_data::tk_null;
+}
+static inline bool _is_numeric_kind(type_data::type_kind kind) {
+	return kind == type_data::tk_int || kind == type_data::tk_float;
+}
+static inline bool _test_compare(command_kind cmp, int cmp_r) {
+	switch (cmp) {
+	case command_kind::pc_inline_cmp_e: return cmp_r == 0;
+	case command_kind::pc_inline_cmp_g: return cmp_r > 0;
+	case command_kind::pc_inline_cmp_ge: return cmp_r >= 0;
+	case command_kind::pc_inline_cmp_l: return cmp_r < 0;
+	case command_kind::pc_inline_cmp_le: return cmp_r <= 0;
+	case command_kind::pc_inline_cmp_ne: return cmp_r != 0;
+	}
+	return false;
+}
+
 void script_machine::run_code() {
 	if (threads.size() == 0) {
-		current_thread_index = std::list<environment*>::iterator();
+		current_thread_index = std::list<microthread>::iterator();
 		return;
 	}
 	try {
 		while (!finished && !bTerminate) {
-			environment* current = *current_thread_index;
+			environment* current = current_thread_index->env;
 
 			if (current->waitCount > 0) {
 				--(current->waitCount);
@@ -317,13 +1016,14 @@ void script_machine::run_code() {
 				}
 				else {
 					if (current->sub->kind == block_kind::bk_microthread) {
+						thread_orders.erase(current_thread_index->order);
 						current_thread_index = threads.erase(current_thread_index);
 						yield();
 					}
 					else {
 						if (current->has_result && parent != nullptr)
 							parent->stack.push_back(current->variables[0]);
-						*current_thread_index = parent;
+						current_thread_index->env = parent;
 					}
 
 					for (environment* pEnv = current; pEnv != nullptr;) {
@@ -335,6 +1035,21 @@ void script_machine::run_code() {
 				}
 			}
 			else {
+				if (instruction_count >= instruction_limit) {
+					if (!budget_overrun) {
+						budget_overrun = true;
+						if (budget_callback)
+							budget_callback(this, current->sub->codes[current->ip].GetLine());
+					}
+
+					//The list head is where events and the main block run, those can't be suspended
+					if (budget_yield && current_thread_index != threads.begin()) {
+						yield();
+						continue;
+					}
+				}
+				++instruction_count;
+
 				script_value_vector& stack = current->stack;
 				script_value_vector& variables = current->variables;
 
@@ -342,6 +1057,11 @@ void script_machine::run_code() {
 				error_line = c->GetLine();
 				++(current->ip);
 
+				if (profiler != nullptr && --profile_countdown == 0) {
+					profile_countdown = profiler->interval;
+					profiler->take_sample(current, error_line);
+				}
+
 				command_kind opc = c->GetOp();
 
 				switch (opc) {
@@ -351,6 +1071,14 @@ void script_machine::run_code() {
 					current->waitCount = (int)t->as_int() - 1;
 					stack.pop_back();
 					if (current->waitCount < 0) break;
+
+					//Take it out of the list instead of visiting it every sweep just to count down.
+					//	The list head keeps counting down, it's where events run.
+					if (current->waitCount > 0 && sweep_nested == 0
+						&& current_thread_index != threads.begin())
+					{
+						sleep_thread();
+					}
 				}
 				//Fallthrough
 				case command_kind::pc_yield:
@@ -372,6 +1100,8 @@ void script_machine::run_code() {
 
 				case command_kind::pc_pop:
 					stack.pop_back(c->arg0);
+					if (pinned_arrays.size() > 0)
+						release_pinned_arrays(&stack);
 					break;
 				case command_kind::pc_push_value:
 					stack.push_back(c->data);
@@ -487,6 +1217,8 @@ void script_machine::run_code() {
 							}
 						}
 						stack.pop_back(2U);
+						if (pinned_arrays.size() > 0)
+							release_pinned_arrays(&stack);
 					}
 
 					break;
@@ -539,7 +1271,7 @@ void script_machine::run_code() {
 							argv = stack.at + (sizePrev - c->arg1);
 
 						if (sub->func != BaseFunction::invoke) {
-							value ret = sub->func(this, c->arg1, argv);
+							value ret = call_native(sub->func, c->arg1, argv);
 							if (stopped) {
 								--(current->ip);
 							}
@@ -553,7 +1285,7 @@ void script_machine::run_code() {
 							if (!error) {
 								script_block* subIvk = (script_block*)(argv[0].as_int() & 0xffffffff);
 								if (subIvk->func) {
-									value ret = subIvk->func(this, subIvk->arguments, argv + 1);
+									value ret = call_native(subIvk->func, subIvk->arguments, argv + 1);
 									_ProcessReturn_BuiltinFunc(ret);
 								}
 								else if (subIvk->kind == block_kind::bk_microthread) {
@@ -655,15 +1387,14 @@ void script_machine::run_code() {
 					value* i = &stack.back();
 					value* src_array = i - 1;
 
-					std::vector<value>::iterator itrCur = src_array->array_get_begin() + i->as_int();
-					std::vector<value>::iterator itrEnd = src_array->array_get_end();
+					size_t iCur = i->as_int();
 
 					bool bSkip = false;
-					if (src_array->get_type()->get_kind() != type_data::tk_array || itrCur >= itrEnd) {
+					if (src_array->get_type()->get_kind() != type_data::tk_array || iCur >= src_array->length_as_array()) {
 						bSkip = true;
 					}
 					else {
-						stack.push_back(*itrCur);
+						stack.push_back(src_array->get_element_as_array(iCur));
 						//stack.back().make_unique();
 						i->set(i->get_type(), i->as_int() + 1i64);
 					}
@@ -729,6 +1460,8 @@ void script_machine::run_code() {
 						*var = res;
 						if (c->arg1)
 							stack.pop_back();
+						if (pinned_arrays.size() > 0)
+							release_pinned_arrays(&stack);
 					}
 					break;
 				}
@@ -781,6 +1514,8 @@ void script_machine::run_code() {
 						pDest = res;
 
 						stack.pop_back(2U);
+						if (pinned_arrays.size() > 0)
+							release_pinned_arrays(&stack);
 					}
 					break;
 				}
@@ -803,6 +1538,8 @@ void script_machine::run_code() {
 						BaseFunction::concatenate_direct(this, 2, arg);
 
 						stack.pop_back(2U);
+						if (pinned_arrays.size() > 0)
+							release_pinned_arrays(&stack);
 					}
 					break;
 				}
@@ -925,9 +1662,14 @@ void script_machine::run_code() {
 					value* arr = &stack.back() - 1;
 					value* idx = arr + 1;
 
-					value* pRes = (value*)BaseFunction::index(this, 2, arr->as_ptr(), idx);
+					value* target = arr->as_ptr();
+					value* pRes = (value*)BaseFunction::index(this, 2, target, idx);
 					if (pRes == nullptr) break;
 
+					//Keeps the reference valid until the instruction using it pops it
+					if (value_array* pinned = target->pin_as_array())
+						pinned_arrays.push_back({ &stack, stack.size() - 2U, pinned });
+
 					*arr = value(script_type_manager::get_ptr_type(), pRes);
 					stack.pop_back(1U);	//pop idx
 					break;
@@ -937,9 +1679,9 @@ void script_machine::run_code() {
 					value* arr = &stack.back() - 1;
 					value* idx = arr + 1;
 
-					value* pRes = (value*)BaseFunction::index(this, 2, arr, idx);
-					if (pRes == nullptr) break;
-					value res = *pRes;
+					//Read by value, keeps packed arrays packed
+					value res;
+					if (!BaseFunction::index_value(this, 2, arr, idx, &res)) break;
 
 					//stack.pop_back(2U);
 					//stack.push_back(res);
@@ -947,6 +1689,18 @@ void script_machine::run_code() {
 					stack.back() = res;
 					break;
 				}
+				case command_kind::pc_inline_set_array:
+				{
+					value* arr = &stack.back() - 2;
+
+					//Writes through the array instead of an element reference, keeps packed arrays packed
+					BaseFunction::index_assign(this, arr->as_ptr(), arr + 1, arr + 2);
+
+					stack.pop_back(3U);
+					if (pinned_arrays.size() > 0)
+						release_pinned_arrays(&stack);
+					break;
+				}
 				case command_kind::pc_inline_length_array:
 				{
 					value* var = &stack.back();
@@ -954,6 +1708,142 @@ void script_machine::run_code() {
 					var->reset(script_type_manager::get_int_type(), (int64_t)len);
 					break;
 				}
+
+				//-------------------------------Typed inline operations-------------------------------
+				case command_kind::pc_inline_add_int:
+				case command_kind::pc_inline_sub_int:
+				case command_kind::pc_inline_mul_int:
+				case command_kind::pc_inline_fdiv_int:
+				case command_kind::pc_inline_mod_int:
+				case command_kind::pc_inline_add_float:
+				case command_kind::pc_inline_sub_float:
+				case command_kind::pc_inline_mul_float:
+				case command_kind::pc_inline_div_float:
+				case command_kind::pc_inline_fdiv_float:
+				case command_kind::pc_inline_mod_float:
+				{
+					value* args = &stack.back() - 1;
+					perform_typed_arith(opc, args, args);
+					stack.pop_back();
+					break;
+				}
+				case command_kind::pc_inline_cmp_int:
+				case command_kind::pc_inline_cmp_float:
+				{
+					value* args = &stack.back() - 1;
+					bool b = _test_compare((command_kind)c->arg0, perform_typed_compare(opc, args));
+					args->reset(script_type_manager::get_boolean_type(), b);
+					stack.pop_back();
+					break;
+				}
+
+				//-------------------------------------Intrinsics--------------------------------------
+				case command_kind::pc_inline_sin:
+				case command_kind::pc_inline_cos:
+				case command_kind::pc_inline_rsin:
+				case command_kind::pc_inline_rcos:
+				case command_kind::pc_inline_atan2:
+				case command_kind::pc_inline_ratan2:
+				case command_kind::pc_inline_sqrt:
+				case command_kind::pc_inline_hypot:
+				case command_kind::pc_inline_distance:
+				case command_kind::pc_inline_trunc:
+				{
+					value* args = &stack.back() - (c->arg0 - 1);
+					double res = BaseFunction::_script_intrinsic(opc, args);
+					args->reset(script_type_manager::get_float_type(), res);
+					stack.pop_back(c->arg0 - 1);
+					break;
+				}
+
+				//----------------------------------Superinstructions----------------------------------
+				case command_kind::pc_loop_count_jump:
+				{
+					value* i = &stack.back();
+					int64_t r = i->as_int();
+					if (r > 0)
+						i->reset(script_type_manager::get_int_type(), r - 1);
+					else
+						current->ip = c->arg0;
+					break;
+				}
+				case command_kind::pc_loop_ascent_jump:
+				case command_kind::pc_loop_descent_jump:
+				{
+					value* cmp_arg = &stack.back() - 1;
+					value cmp_res = BaseFunction::compare(this, 2, cmp_arg);
+
+					bool bSkip = opc == command_kind::pc_loop_ascent_jump ?
+						(cmp_res.as_int() <= 0) : (cmp_res.as_int() >= 0);
+					if (bSkip)
+						current->ip = c->arg0;
+					break;
+				}
+				case command_kind::pc_cmp_jump:
+				{
+					value args[2];
+					if (!fetch_operands(current, c, args, 2)) break;
+					current->ip += 2;
+
+					uint32_t cmpTyped = c->arg1 >> 16;
+					int cmp_r = cmpTyped ? perform_typed_compare((command_kind)cmpTyped, args) :
+						BaseFunction::compare(this, 2, args).as_int();
+
+					bool b = _test_compare((command_kind)(c->arg1 & 0xff), cmp_r);
+					if (b == (((c->arg1 >> 8) & 1) != 0))
+						current->ip = c->arg0;
+					break;
+				}
+				case command_kind::pc_op_assign:
+				case command_kind::pc_op_asi:
+				{
+					size_t countOperand = opc == command_kind::pc_op_assign ? 2 : 1;
+
+					value args[2];
+					if (!fetch_operands(current, c, args + (2 - countOperand), countOperand)) break;
+					current->ip += countOperand;
+
+					uint32_t level = ARG1_GET_LEVEL(c->arg1);
+					uint32_t variable = ARG1_GET_VAR(c->arg1);
+					value* dest = opc == command_kind::pc_op_assign ?
+						find_variable_symbol<true>(current, c, level, variable) :
+						find_variable_symbol<false>(current, c, level, variable);
+					if (dest == nullptr) break;
+					if (opc == command_kind::pc_op_asi)
+						args[0] = *dest;
+
+					value res;
+					command_kind opArith = (command_kind)c->arg0;
+#define DEF_CASE(cmd, fn) case cmd: res = BaseFunction::fn(this, 2, args); break;
+					switch (opArith) {
+						DEF_CASE(command_kind::pc_inline_add, add);
+						DEF_CASE(command_kind::pc_inline_sub, subtract);
+						DEF_CASE(command_kind::pc_inline_mul, multiply);
+						DEF_CASE(command_kind::pc_inline_div, divide);
+						DEF_CASE(command_kind::pc_inline_fdiv, fdivide);
+						DEF_CASE(command_kind::pc_inline_mod, remainder_);
+						DEF_CASE(command_kind::pc_inline_pow, power);
+					default:
+						perform_typed_arith(opArith, args, &res);
+					}
+#undef DEF_CASE
+
+					if (opc == command_kind::pc_op_asi) {
+						BaseFunction::_value_cast(&res, dest->get_type());
+						*dest = res;
+					}
+					else if (!error && BaseFunction::_type_assign_check(this, &res, dest)) {
+						//Same as pc_copy_assign
+						type_data* prev_type = dest->get_type();
+
+						*dest = res;
+						dest->make_unique();
+
+						if (prev_type && prev_type != res.get_type())
+							BaseFunction::_value_cast(dest, prev_type);
+					}
+					break;
+				}
 				}
 			}
 
@@ -971,24 +1861,23 @@ void script_machine::run_code() {
 template<bool ALLOW_NULL>
 value* script_machine::find_variable_symbol(environment* current_env, code* c,
 	uint32_t level, uint32_t variable) {
-	for (environment* i = current_env; i != nullptr; i = i->parent) {
-		if (i->sub->level == level) {
-			value* res = &(i->variables[variable]);
-
-			if constexpr (ALLOW_NULL)
+	environment* i = level < current_env->display.size() ? current_env->display[level] : nullptr;
+	if (i != nullptr && variable < i->variables.size()) {
+		value* res = &(i->variables[variable]);
+
+		if constexpr (ALLOW_NULL)
+			return res;
+		else {
+			if (res->has_data())
 				return res;
 			else {
-				if (res->has_data())
-					return res;
-				else {
 #ifdef _DEBUG
-					raise_error(StringUtility::Format("Variable hasn't been initialized: %s\r\n",
-						c->var_name.c_str()));
+				raise_error(StringUtility::Format("Variable hasn't been initialized: %s\r\n",
+					c->var_name.c_str()));
 #else
-					raise_error("Variable hasn't been initialized.\r\n");
+				raise_error("Variable hasn't been initialized.\r\n");
 #endif
-					return nullptr;
-				}
+				return nullptr;
 			}
 		}
 	}
@@ -1001,4 +1890,124 @@ value* script_machine::find_variable_symbol(environment* current_env, code* c,
 		level, variable));
 #endif
 	return nullptr;
-}
\ No newline at end of file
+}
+//Reads the operand codes of a superinstruction, same as running them as pushes
+bool script_machine::fetch_operands(environment* current_env, code* c, value* res, size_t count) {
+	for (size_t i = 0; i < count; ++i) {
+		code* operand = c + 1 + i;
+		if (operand->GetOp() == command_kind::pc_push_value) {
+			res[i] = operand->data;
+		}
+		else {
+			value* var = find_variable_symbol<false>(current_env, operand, operand->arg0, operand->arg1);
+			if (var == nullptr) return false;
+			res[i] = *var;
+		}
+	}
+	return true;
+}
+//Typed arithmetic, res may alias args
+//	Takes the untyped path if the operands aren't what the parser expected, like an uninitialized variable
+void script_machine::perform_typed_arith(command_kind op, const value* args, value* res) {
+	type_data::type_kind kind_l = _get_value_kind(&args[0]);
+	type_data::type_kind kind_r = _get_value_kind(&args[1]);
+
+	if (op <= command_kind::pc_inline_mod_int) {
+		if (kind_l == type_data::tk_int && kind_r == type_data::tk_int) {
+			int64_t a = args[0].as_int();
+			int64_t b = args[1].as_int();
+			type_data* typeInt = script_type_manager::get_int_type();
+
+			switch (op) {
+			case command_kind::pc_inline_add_int: res->reset(typeInt, a + b); return;
+			case command_kind::pc_inline_sub_int: res->reset(typeInt, a - b); return;
+			case command_kind::pc_inline_mul_int: res->reset(typeInt, a * b); return;
+			case command_kind::pc_inline_fdiv_int:
+				if (b == 0) break;	//The untyped path raises the error
+				res->reset(typeInt, a / b);
+				return;
+			case command_kind::pc_inline_mod_int: res->reset(typeInt, BaseFunction::_mod2(a, b)); return;
+			}
+		}
+	}
+	else if (_is_numeric_kind(kind_l) && _is_numeric_kind(kind_r)
+		&& (kind_l == type_data::tk_float || kind_r == type_data::tk_float || op == command_kind::pc_inline_div_float))
+	{
+		double a = args[0].as_float();
+		double b = args[1].as_float();
+		type_data* typeFloat = script_type_manager::get_float_type();
+
+		switch (op) {
+		case command_kind::pc_inline_add_float: res->reset(typeFloat, a + b); return;
+		case command_kind::pc_inline_sub_float: res->reset(typeFloat, a - b); return;
+		case command_kind::pc_inline_mul_float: res->reset(typeFloat, a * b); return;
+		case command_kind::pc_inline_div_float: res->reset(typeFloat, a / b); return;
+		case command_kind::pc_inline_fdiv_float: res->reset(script_type_manager::get_int_type(), (int64_t)(a / b)); return;
+		case command_kind::pc_inline_mod_float: res->reset(typeFloat, BaseFunction::_fmod2(a, b)); return;
+		}
+	}
+
+#define DEF_CASE(cmd_i, cmd_f, fn) case cmd_i: case cmd_f: *res = BaseFunction::fn(this, 2, args); break;
+	switch (op) {
+		DEF_CASE(command_kind::pc_inline_add_int, command_kind::pc_inline_add_float, add);
+		DEF_CASE(command_kind::pc_inline_sub_int, command_kind::pc_inline_sub_float, subtract);
+		DEF_CASE(command_kind::pc_inline_mul_int, command_kind::pc_inline_mul_float, multiply);
+		DEF_CASE(command_kind::pc_inline_fdiv_int, command_kind::pc_inline_fdiv_float, fdivide);
+		DEF_CASE(command_kind::pc_inline_mod_int, command_kind::pc_inline_mod_float, remainder_);
+	case command_kind::pc_inline_div_float:
+		*res = BaseFunction::divide(this, 2, args);
+		break;
+	}
+#undef DEF_CASE
+}
+//Typed comparison, returns the same as BaseFunction::compare
+int script_machine::perform_typed_compare(command_kind op, const value* args) {
+	type_data::type_kind kind_l = _get_value_kind(&args[0]);
+	type_data::type_kind kind_r = _get_value_kind(&args[1]);
+
+	if (op == command_kind::pc_inline_cmp_int) {
+		if (kind_l == type_data::tk_int && kind_r == type_data::tk_int) {
+			int64_t a = args[0].as_int();
+			int64_t b = args[1].as_int();
+			return (a == b) ? 0 : (a < b) ? -1 : 1;
+		}
+	}
+	else if (_is_numeric_kind(kind_l) && _is_numeric_kind(kind_r)
+		&& (kind_l == type_data::tk_float || kind_r == type_data::tk_float))
+	{
+		double a = args[0].as_float();
+		double b = args[1].as_float();
+		return (a == b) ? 0 : (a < b) ? -1 : 1;
+	}
+
+	return BaseFunction::compare(this, 2, args).as_int();
+}
+
+//****************************************************************************
+//script_profiler
+//****************************************************************************
+script_profiler::script_profiler(uint32_t interval) {
+	this->interval = interval > 0 ? interval : 1;
+	total = 0;
+}
+void script_profiler::clear() {
+	total = 0;
+	samples.clear();
+}
+void script_profiler::take_sample(script_machine::environment* env, int line) {
+	buffer.stack.clear();
+	for (; env != nullptr; env = env->parent) {
+		script_block* sub = env->sub;
+		if (sub->kind != block_kind::bk_normal || env->parent == nullptr)
+			buffer.stack.push_back(sub);
+
+		//A task's parent env is where it was started, which has long moved on
+		if (sub->kind == block_kind::bk_microthread)
+			break;
+	}
+	std::reverse(buffer.stack.begin(), buffer.stack.end());
+	buffer.line = line;
+
+	++samples[buffer];
+	++total;
+}
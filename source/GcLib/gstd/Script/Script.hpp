@@ -33,6 +33,7 @@ namespace gstd {
 		script_type_manager(const script_type_manager& src);
 
 		std::set<type_data> types;
+		std::shared_mutex mtx_types;	//Scripts may run on more than one thread
 
 		//Common types for quick access without std::set traversal
 		type_data* null_type;
@@ -54,12 +55,29 @@ namespace gstd {
 
 	class script_engine {
 	public:
-		script_engine(const std::wstring& source, std::vector<function>* list_func, std::vector<constant>* list_const);
-		script_engine(const std::vector<char>& source, std::vector<function>* list_func, std::vector<constant>* list_const);
-		script_engine(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const);
+		//Serialized bytecode format, bump when command_kind or the operands of any code change
+		static const uint32_t BYTECODE_VERSION = 3;
+
+		//Interned @event names, shared by every engine, the common ones have fixed IDs
+		enum : uint32_t {
+			EVENT_INITIALIZE,
+			EVENT_MAIN_LOOP,
+			EVENT_EVENT,
+			EVENT_FINALIZE,
+			EVENT_LOADING,
+		};
+	public:
+		script_engine();
+		script_engine(const std::wstring& source, std::vector<function>* list_func, std::vector<constant>* list_const,
+			bool peephole = true);
+		script_engine(const std::vector<char>& source, std::vector<function>* list_func, std::vector<constant>* list_const,
+			bool peephole = true);
+		script_engine(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const,
+			bool peephole = true);
 		virtual ~script_engine();
 
-		void init(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const);
+		void init(const wchar_t* source, const wchar_t* end, std::vector<function>* list_func, std::vector<constant>* list_const,
+			bool peephole);
 
 		script_engine& operator=(const script_engine& source) = default;
 
@@ -68,6 +86,14 @@ namespace gstd {
 		int get_error_line() { return error_line; }
 
 		script_block* new_block(int level, block_kind kind);
+
+		bool save_bytecode(std::vector<char>& dst);
+		bool load_bytecode(const std::vector<char>& src, std::vector<function>* list_func);
+
+		static uint32_t get_event_id(const std::string& name);
+		script_block* get_event(uint32_t id) { return id < event_table.size() ? event_table[id] : nullptr; }
+	private:
+		void build_event_table();
 	public:
 		void* data;		//Client script pointer
 
@@ -78,6 +104,18 @@ namespace gstd {
 		std::list<script_block> blocks;
 		script_block* main_block;
 		std::map<std::string, script_block*> events;
+		std::vector<script_block*> event_table;		//[event ID] -> block, nullptr if not defined
+	};
+
+	class script_profiler;
+	class script_machine;
+
+	//Receives the native function calls of the machines it is attached to, lets the host decide where they run
+	class script_call_gate {
+	public:
+		virtual ~script_call_gate() {}
+
+		virtual value call(script_machine* machine, dnh_func_callback_t func, int argc, const value* argv) = 0;
 	};
 
 	class script_machine {
@@ -90,6 +128,7 @@ namespace gstd {
 			script_block* sub;
 			int ip;
 			script_value_vector variables;
+			std::vector<environment*> display;	//[level] -> nearest env of that level up the parent chain
 			script_value_vector stack;
 			bool has_result;
 			int waitCount;
@@ -123,13 +162,55 @@ namespace gstd {
 
 		std::list<environment*> list_parent_environment;
 
-		std::list<environment*> threads;
-		std::list<environment*>::iterator current_thread_index;
+		struct microthread {
+			environment* env;
+			uint64_t order;		//Round-robin position, kept while the thread is asleep
+		};
+		struct sleeping_thread {
+			uint64_t wake;		//Value of sweep_count at which the thread rejoins the list
+			microthread thread;
+
+			bool operator>(const sleeping_thread& other) const { return wake > other.wake; }
+		};
+
+		std::list<microthread> threads;
+		std::list<microthread>::iterator current_thread_index;
+
+		uint64_t sweep_count;							//Times the round-robin has wrapped around
+		size_t sweep_nested;							//Events interrupting a partial sweep
+		std::vector<sleeping_thread> sleeping_threads;	//Min-heap on wake
+		std::set<uint64_t> thread_orders;				//Orders of all microthreads, awake or asleep
+
+		script_profiler* profiler;		//Not owned, nullptr when not profiling
+		uint32_t profile_countdown;		//Instructions left until the next sample
+
+		uint64_t instruction_count;		//Executed since the last reset_instruction_count
+		uint64_t instruction_budget;	//0 if unlimited
+		uint64_t instruction_limit;		//instruction_count past which the budget is exceeded
+		bool budget_yield;				//Force tasks past the budget to yield
+		bool budget_overrun;
+		void (*budget_callback)(script_machine* machine, int line);	//Called once each time the budget is exceeded
+
+		script_call_gate* call_gate;	//Not owned, nullptr to call natives directly
+
+		struct pinned_array {
+			const script_value_vector* stack;
+			size_t depth;			//Unpinned once the stack is back down to this size
+			value_array* arr;
+		};
+		std::vector<pinned_array> pinned_arrays;	//Arrays with an element reference on a stack, see value_array::pinned
 	private:
 		void alloc_env_chunk(size_t chunk);
 
+		uint64_t get_new_thread_order();
+		void relabel_threads();
+		void sleep_thread();
+		void wake_threads(bool bAll);
+
 		environment* get_new_environment();
 		void dispose_environment(environment* env);
+
+		void release_pinned_arrays(const script_value_vector* stack);
 	public:
 		script_machine(script_engine* the_engine);
 		virtual ~script_machine();
@@ -143,6 +224,7 @@ namespace gstd {
 
 		void call(const std::string& event_name);
 		void call(std::map<std::string, script_block*>::iterator event_itr);
+		void call(script_block* event);
 
 		void resume();
 		void stop() {
@@ -175,22 +257,75 @@ namespace gstd {
 		script_engine* get_engine() { return engine; }
 
 		bool has_event(const std::string& event_name, std::map<std::string, script_block*>::iterator& res);
+		script_block* get_event(uint32_t id) { return engine->get_event(id); }
 		int get_current_line();
 		int get_current_thread_addr() { return (int)current_thread_index._Ptr; }
 
-		size_t get_thread_count() { return threads.size(); }
+		size_t get_thread_count() { return threads.size() + sleeping_threads.size(); }
+
+		void set_profiler(script_profiler* p);
+		script_profiler* get_profiler() { return profiler; }
+
+		void set_instruction_budget(uint64_t budget, bool bYield);
+		uint64_t get_instruction_budget() { return instruction_budget; }
+		uint64_t get_instruction_count() { return instruction_count; }
+		uint64_t reset_instruction_count();
+		bool is_budget_overrun() { return budget_overrun; }
+
+		void set_call_gate(script_call_gate* gate) { call_gate = gate; }
+		script_call_gate* get_call_gate() { return call_gate; }
 	private:
 		void yield() {
-			if (current_thread_index == threads.begin())
+			if (current_thread_index == threads.begin()) {
+				if (sweep_nested > 0)
+					wake_threads(true);
+				++sweep_count;
+				if (sleeping_threads.size() > 0 && sleeping_threads.front().wake <= sweep_count)
+					wake_threads(false);
 				current_thread_index = std::prev(threads.end());
+			}
 			else
 				--current_thread_index;
 		}
 
+		value call_native(dnh_func_callback_t func, int argc, const value* argv) {
+			if (call_gate) return call_gate->call(this, func, argc, argv);
+			return func(this, argc, argv);
+		}
+
 		void run_code();
 
 		template<bool ALLOW_NULL>
 		value* find_variable_symbol(environment* current_env, code* c,
 			uint32_t level, uint32_t variable);
+		bool fetch_operands(environment* current_env, code* c, value* res, size_t count);
+
+		void perform_typed_arith(command_kind op, const value* args, value* res);
+		int perform_typed_compare(command_kind op, const value* args);
+	};
+
+	//Samples the call stack of a script_machine every [interval] executed instructions
+	class script_profiler {
+	public:
+		struct sample_key {
+			std::vector<script_block*> stack;	//Outermost first; only the main block, subs, functions and tasks
+			int line;							//Line of the sampled instruction
+
+			bool operator<(const sample_key& other) const {
+				if (line != other.line) return line < other.line;
+				return stack < other.stack;
+			}
+		};
+	public:
+		uint32_t interval;
+		uint64_t total;
+		std::map<sample_key, uint64_t> samples;
+	private:
+		sample_key buffer;
+	public:
+		script_profiler(uint32_t interval);
+
+		void clear();
+		void take_sample(script_machine::environment* env, int line);
 	};
 }
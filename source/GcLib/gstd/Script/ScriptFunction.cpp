@@ -182,17 +182,17 @@ namespace gstd {
 			size_t ct_op = std::min(v_right->length_as_array(), ct_left);
 			value v[2];
 			for (size_t i = 0; i < ct_op; ++i) {
-				v[0] = (*v_left)[i];
-				v[1] = (*v_right)[i];
+				v[0] = v_left->get_element_as_array(i);
+				v[1] = v_right->get_element_as_array(i);
 				resArr[i] = func(2, v);
 			}
-			for (size_t i = ct_op; i < ct_left; ++i) resArr[i] = (*v_left)[i];
+			for (size_t i = ct_op; i < ct_left; ++i) resArr[i] = v_left->get_element_as_array(i);
 		}
 		else {
 			value v[2];
 			v[1] = *v_right;
 			for (size_t i = 0; i < ct_left; ++i) {
-				v[0] = (*v_left)[i];
+				v[0] = v_left->get_element_as_array(i);
 				resArr[i] = func(2, v);
 			}
 		}
@@ -203,19 +203,6 @@ namespace gstd {
 		return result;
 	}
 
-	inline double BaseFunction::_fmod2(double i, double j) {
-		if (j < 0)
-			return (i < 0) ? -fmod(-i, -j) : fmod(fmod(i, -j) + j, j);
-		else
-			return (i < 0) ? fmod(j - fmod(-i, j), j) : fmod(i, j);
-	}
-	inline int64_t BaseFunction::_mod2(int64_t i, int64_t j) {
-		if (j < 0)
-			return (i < 0) ? -((-i) % (-j)) : (((i % (-j)) + j) % j);
-		else
-			return (i < 0) ? ((j - ((-i) % j)) % j) : (i % j);
-	}
-
 	bool BaseFunction::_is_empty_type(value* val) {
 		if (val == nullptr)
 			return true;
@@ -248,7 +235,7 @@ namespace gstd {
 		case type_data::tk_array:
 			if (type_data* castElem = cast->get_element()) {
 				if (val->length_as_array() > 0) {
-					std::vector<value> arrVal = *(val->as_array_ptr());
+					std::vector<value> arrVal = val->as_array();
 					for (value& iVal : arrVal)
 						_value_cast(&iVal, castElem);
 					return val->reset(cast, arrVal);
@@ -599,7 +586,8 @@ namespace gstd {
 			std::vector<value> resArr;
 			resArr.resize(argv->length_as_array());
 			for (size_t i = 0; i < argv->length_as_array(); ++i) {
-				resArr[i] = _script_negative(1, &(*argv)[i]);
+				value elem = argv->get_element_as_array(i);
+				resArr[i] = _script_negative(1, &elem);
 			}
 			result.reset(argv->get_type(), resArr);
 			return result;
@@ -674,10 +662,18 @@ namespace gstd {
 						break;
 					}
 					else {
+						const std::wstring* pStrL = argv[0].as_packed_string();
+						const std::wstring* pStrR = argv[1].as_packed_string();
+						if (pStrL && pStrR) {
+							int c = pStrL->compare(*pStrR);
+							r = (c == 0) ? 0 : (c < 0) ? -1 : 1;
+							break;
+						}
+
 						value v[2];
 						for (size_t i = 0; i < sr; ++i) {
-							v[0] = argv[0][i];
-							v[1] = argv[1][i];
+							v[0] = argv[0].get_element_as_array(i);
+							v[1] = argv[1].get_element_as_array(i);
 							r = _script_compare(2, v).as_float();
 							if (r != 0)
 								break;
@@ -740,7 +736,8 @@ namespace gstd {
 			std::vector<value> resArr;
 			resArr.resize(argv->length_as_array());
 			for (size_t i = 0; i < argv->length_as_array(); ++i) {
-				resArr[i] = predecessor(machine, 1, &(*argv)[i]);
+				value elem = argv->get_element_as_array(i);
+				resArr[i] = predecessor(machine, 1, &elem);
 			}
 			result.reset(argv->get_type(), resArr);
 			return result;
@@ -770,7 +767,8 @@ namespace gstd {
 			std::vector<value> resArr;
 			resArr.resize(argv->length_as_array());
 			for (size_t i = 0; i < argv->length_as_array(); ++i) {
-				resArr[i] = successor(machine, 1, &(*argv)[i]);
+				value elem = argv->get_element_as_array(i);
+				resArr[i] = successor(machine, 1, &elem);
 			}
 			result.reset(argv->get_type(), resArr);
 			return result;
@@ -872,7 +870,7 @@ namespace gstd {
 
 		std::vector<value> arrVal(size);
 
-		for (size_t i = 0; i < size; ++i) arrVal[i] = val->index_as_array(size - i - 1);
+		for (size_t i = 0; i < size; ++i) arrVal[i] = val->get_element_as_array(size - i - 1);
 
 		res.reset(valType, arrVal);
 		return res;
@@ -902,7 +900,7 @@ namespace gstd {
 
 		// Populate source array
 		for (size_t i = 0; i < size; ++i)
-			arrVal[i] = val->index_as_array(i);
+			arrVal[i] = val->get_element_as_array(i);
 
 		for (size_t i = 0; i < size - 1; ++i) {
 			size_t idx = i;
@@ -1001,7 +999,7 @@ namespace gstd {
 		size_t maxHit = bRev ? -target - 1 : target;
 
 		auto check = [&](size_t ind) -> bool {
-			value args[2] = { arr->index_as_array(ind), val };
+			value args[2] = { arr->get_element_as_array(ind), val };
 			if (compare(machine, 2, args).as_int() == 0) {
 				if (hits == maxHit)
 					res = ind;
@@ -1035,7 +1033,7 @@ namespace gstd {
 
 		int64_t res = 0;
 		for (size_t i = 0; i < length; ++i) {
-			value args[2] = { arr->index_as_array(i), val };
+			value args[2] = { arr->get_element_as_array(i), val };
 			if (compare(machine, 2, args).as_int() == 0) {
 				++res;
 			}
@@ -1059,7 +1057,7 @@ namespace gstd {
 
 		bool res = true;
 		for (size_t i = 0; i < length && res; ++i)
-			res = arr->index_as_array(i).as_boolean();
+			res = arr->get_element_as_array(i).as_boolean();
 
 		return value(script_type_manager::get_boolean_type(), res);
 	}
@@ -1080,7 +1078,7 @@ namespace gstd {
 
 		bool res = false;
 		for (size_t i = 0; i < length && !res; ++i)
-			res = arr->index_as_array(i).as_boolean();
+			res = arr->get_element_as_array(i).as_boolean();
 
 		return value(script_type_manager::get_boolean_type(), res);
 	}
@@ -1108,7 +1106,7 @@ namespace gstd {
 		if (addType != elemType)
 			BaseFunction::_value_cast(&replaceTo, elemType);
 
-		std::vector<value> arrVal = *val->as_array_ptr();
+		std::vector<value> arrVal = val->as_array();
 
 		for (size_t i = 0; i < size; ++i) {
 			value args[2] = { arrVal[i], replaceFrom };
@@ -1171,7 +1169,42 @@ namespace gstd {
 		if (!_index_check(machine, arr->get_type(), length, index))
 			return nullptr;
 
-		return &(*arr)[index];
+		return &arr->index_as_array(index);
+	}
+	bool BaseFunction::index_value(script_machine* machine, int argc, const value* arr, const value* indexer, value* res) {
+		_null_check(machine, arr, 1);
+
+		int index = indexer->as_int();
+		size_t length = arr->length_as_array();
+
+		if (index < 0) index += length;
+		if (!_index_check(machine, arr->get_type(), length, index))
+			return false;
+
+		*res = arr->get_element_as_array(index);
+		return true;
+	}
+	void BaseFunction::index_assign(script_machine* machine, value* arr, const value* indexer, const value* src) {
+		if (!_null_check(machine, arr, 1)) return;
+
+		int index = indexer->as_int();
+		size_t length = arr->length_as_array();
+
+		if (index < 0) index += length;
+		if (!_index_check(machine, arr->get_type(), length, index))
+			return;
+
+		value dest = arr->get_element_as_array(index);
+		if (!_type_assign_check(machine, src, &dest))
+			return;
+
+		//Same conversion as pc_ref_assign, the element keeps its type
+		type_data* prev_type = dest.get_type();
+		dest = *src;
+		if (prev_type && prev_type != src->get_type())
+			_value_cast(&dest, prev_type);
+
+		arr->set_element_as_array(index, dest);
 	}
 
 	value BaseFunction::slice(script_machine* machine, int argc, const value* argv) {
@@ -1198,26 +1231,42 @@ namespace gstd {
 		value result;
 		std::vector<value> resArr;
 
+		//Strings slice straight out of the packed buffer
+		if (const std::wstring* pStr = argv[0].as_packed_string()) {
+			std::wstring resStr;
+			if (length > 0) {
+				if (index_2 > index_1) {
+					index_1 = std::max<int>(index_1, 0);
+					index_2 = std::min<int>(index_2, length);
+					if (index_2 > index_1)
+						resStr = pStr->substr(index_1, index_2 - index_1);
+				}
+				else if (index_1 > index_2) {		//Reverse
+					index_1 = std::min<int>(index_1, length);
+					index_2 = std::max<int>(index_2, 0);
+					if (index_1 > index_2)
+						resStr.assign(pStr->rbegin() + (length - index_1), pStr->rbegin() + (length - index_2));
+				}
+			}
+			return value(argv[0].get_type(), resStr);
+		}
+
 		if (length > 0) {
 			if (index_2 > index_1) {
 				index_1 = std::max<int>(index_1, 0);
 				index_2 = std::min<int>(index_2, length);
 
 				resArr.resize(index_2 - index_1);
-				for (size_t i = 0, j = index_1; i < resArr.size(); ++i, ++j) {
-					const value& v = argv[0][j];
-					resArr[i] = v;
-				}
+				for (size_t i = 0, j = index_1; i < resArr.size(); ++i, ++j)
+					resArr[i] = argv[0].get_element_as_array(j);
 			}
 			else if (index_1 > index_2) {		//Reverse
 				index_1 = std::min<int>(index_1, length);
 				index_2 = std::max<int>(index_2, 0);
 
 				resArr.resize(index_1 - index_2);
-				for (size_t i = 0, j = index_1 - 1; i < resArr.size(); ++i, --j) {
-					const value& v = argv[0][j];
-					resArr[i] = v;
-				}
+				for (size_t i = 0, j = index_1 - 1; i < resArr.size(); ++i, --j)
+					resArr[i] = argv[0].get_element_as_array(j);
 			}
 		}
 
@@ -1274,11 +1323,11 @@ namespace gstd {
 		{
 			size_t iArr = 0;
 			for (size_t i = 0; i < insertPos; ++i) {
-				resArr[iArr++] = argv[0][i];
+				resArr[iArr++] = argv[0].get_element_as_array(i);
 			}
 			resArr[iArr++] = insertVal;
 			for (size_t i = insertPos; i < length; ++i) {
-				resArr[iArr++] = argv[0][i];
+				resArr[iArr++] = argv[0].get_element_as_array(i);
 			}
 		}
 
@@ -1313,10 +1362,10 @@ namespace gstd {
 		{
 			size_t iArr = 0;
 			for (size_t i = 0; i < index_1; ++i) {
-				resArr[iArr++] = argv[0][i];
+				resArr[iArr++] = argv[0].get_element_as_array(i);
 			}
 			for (size_t i = index_1 + 1; i < length; ++i) {
-				resArr[iArr++] = argv[0][i];
+				resArr[iArr++] = argv[0].get_element_as_array(i);
 			}
 		}
 
@@ -1437,6 +1486,36 @@ namespace gstd {
 	}
 	SCRIPT_DECLARE_OP(absolute);
 
+	//Math builtins the parser lowers to pc_inline_* opcodes, must match their script functions
+	double BaseFunction::_script_intrinsic(command_kind op, const value* argv) {
+		switch (op) {
+		case command_kind::pc_inline_sin:
+			return std::sin(Math::DegreeToRadian(argv[0].as_float()));
+		case command_kind::pc_inline_cos:
+			return std::cos(Math::DegreeToRadian(argv[0].as_float()));
+		case command_kind::pc_inline_rsin:
+			return std::sin(argv[0].as_float());
+		case command_kind::pc_inline_rcos:
+			return std::cos(argv[0].as_float());
+		case command_kind::pc_inline_atan2:
+			return Math::RadianToDegree(std::atan2(argv[0].as_float(), argv[1].as_float()));
+		case command_kind::pc_inline_ratan2:
+			return std::atan2(argv[0].as_float(), argv[1].as_float());
+		case command_kind::pc_inline_sqrt:
+			return std::sqrt(argv[0].as_float());
+		case command_kind::pc_inline_hypot:
+			return std::hypot(argv[0].as_float(), argv[1].as_float());
+		case command_kind::pc_inline_distance:
+			return std::hypot(argv[2].as_float() - argv[0].as_float(), argv[3].as_float() - argv[1].as_float());
+		case command_kind::pc_inline_trunc:
+		{
+			double r = argv[0].as_float();
+			return (r > 0) ? std::floor(r) : std::ceil(r);
+		}
+		}
+		return 0.0;
+	}
+
 #define BITWISE_RET if (_is_force_convert_float(argv[0].get_type()) || _is_force_convert_float(argv[1].get_type())) \
 						return value(script_type_manager::get_float_type(), (double)res); \
 					else \
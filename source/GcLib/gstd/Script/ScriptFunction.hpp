@@ -15,16 +15,21 @@ namespace gstd {
 #define DNH_FUNCAPI_DECL_(_fn) static gstd::value _fn (gstd::script_machine*, int, const gstd::value*)
 #define DNH_FUNCAPI_DEF_(_fn) gstd::value _fn (gstd::script_machine* machine, int argc, const gstd::value* argv)
 
+	enum class command_kind : uint8_t;
+
 	struct function {
 		const char* name;
 		dnh_func_callback_t func;
 		int argc;
 		const char* signature;
+		command_kind intrinsic;		//Inline opcode the parser can replace calls with, pc_nop if none
 
 		function(const char* name_, dnh_func_callback_t func_) : function(name_, func_, 0, "") {};
 		function(const char* name_, dnh_func_callback_t func_, int argc_) : function(name_, func_, argc_, "") {};
 		function(const char* name_, dnh_func_callback_t func_, int argc_, const char* signature_) : name(name_),
-			func(func_), argc(argc_), signature(signature_) {};
+			func(func_), argc(argc_), signature(signature_), intrinsic((command_kind)0xff) {};
+		function(const char* name_, dnh_func_callback_t func_, int argc_, command_kind intrinsic_) : name(name_),
+			func(func_), argc(argc_), signature(""), intrinsic(intrinsic_) {};
 	};
 	struct constant {
 		const char* name;
@@ -114,6 +119,8 @@ namespace gstd {
 		DNH_FUNCAPI_DECL_(successor);
 
 		static const value* index(script_machine* machine, int argc, value* arr, value* indexer);
+		static bool index_value(script_machine* machine, int argc, const value* arr, const value* indexer, value* res);
+		static void index_assign(script_machine* machine, value* arr, const value* indexer, const value* src);
 
 		DNH_FUNCAPI_DECL_(length);
 		DNH_FUNCAPI_DECL_(generate);
@@ -147,6 +154,8 @@ namespace gstd {
 		static value _script_absolute(int argc, const value* argv);
 		DNH_FUNCAPI_DECL_(absolute);
 
+		static double _script_intrinsic(command_kind op, const value* argv);
+
 		DNH_FUNCAPI_DECL_(bitwiseNot);
 		DNH_FUNCAPI_DECL_(bitwiseAnd);
 		DNH_FUNCAPI_DECL_(bitwiseOr);
@@ -160,4 +169,18 @@ namespace gstd {
 		DNH_FUNCAPI_DECL_(assert_);
 		DNH_FUNCAPI_DECL_(script_debugBreak);
 	};
+
+	//Also used by the typed inline operations in script_machine
+	inline double BaseFunction::_fmod2(double i, double j) {
+		if (j < 0)
+			return (i < 0) ? -fmod(-i, -j) : fmod(fmod(i, -j) + j, j);
+		else
+			return (i < 0) ? fmod(j - fmod(-i, j), j) : fmod(i, j);
+	}
+	inline int64_t BaseFunction::_mod2(int64_t i, int64_t j) {
+		if (j < 0)
+			return (i < 0) ? -((-i) % (-j)) : (((i % (-j)) + j) % j);
+		else
+			return (i < 0) ? ((j - ((-i) % j)) % j) : (i % j);
+	}
 }
\ No newline at end of file
@@ -60,6 +60,11 @@ value::value(type_data* t, value* v) {
 	this->set(t, v);
 }
 value::value(type_data* t, const std::wstring& v) {
+	type_data* elem = t->get_element();
+	if (value_array::get_storage(elem) == value_array::st_char) {
+		this->set(t, ref_unsync_ptr<value_array>(new value_array(elem, v)));
+		return;
+	}
 	std::vector<value> vec(v.size());
 	for (size_t i = 0; i < v.size(); ++i)
 		vec[i] = value(t->get_element(), v[i]);
@@ -99,6 +104,14 @@ value* value::reset(type_data* t, std::vector<value>& v) {
 	release();
 	return this->set(t, v);
 }
+value* value::reset(type_data* t, std::vector<int64_t>&& v) {
+	release();
+	return this->set(t, std::move(v));
+}
+value* value::reset(type_data* t, std::vector<double>&& v) {
+	release();
+	return this->set(t, std::move(v));
+}
 
 #pragma push_macro("new")
 #undef new
@@ -135,19 +148,46 @@ value* value::set(type_data* t, value* v) {
 value* value::set(type_data* t, std::vector<value>& v) {
 	kind = type_data::tk_array;
 	type = t;
-	ref_unsync_ptr<std::vector<value>> nv = new std::vector<value>(v);
+	ref_unsync_ptr<value_array> nv = value_array::create(t ? t->get_element() : nullptr, v);
+	new (&p_array_value) auto(nv);
+	return this;
+}
+value* value::set(type_data* t, std::vector<int64_t>&& v) {
+	kind = type_data::tk_array;
+	type = t;
+	ref_unsync_ptr<value_array> nv = new value_array(t->get_element(), std::move(v));
 	new (&p_array_value) auto(nv);
 	return this;
 }
-value* value::set(type_data* t, ref_unsync_ptr<std::vector<value>> v) {
+value* value::set(type_data* t, std::vector<double>&& v) {
+	kind = type_data::tk_array;
+	type = t;
+	ref_unsync_ptr<value_array> nv = new value_array(t->get_element(), std::move(v));
+	new (&p_array_value) auto(nv);
+	return this;
+}
+value* value::set(type_data* t, ref_unsync_ptr<value_array> v) {
 	kind = type_data::tk_array;
 	type = t;
 	new (&p_array_value) auto(v);
 	return this;
 }
 value* value::set(type_data* t) {
+	bool bWasArray = has_data() && kind == type_data::tk_array;
+
 	kind = t ? t->get_kind() : type_data::tk_null;
 	type = t;
+
+	//The payload overlaps the array pointer, so it has to be created or dropped along with the kind
+	bool bIsArray = t && kind == type_data::tk_array;
+	if (bWasArray && !bIsArray) {
+		p_array_value.~ref_count_ptr();
+	}
+	else if (!bWasArray && bIsArray) {
+		std::vector<value> empty;
+		ref_unsync_ptr<value_array> nv = value_array::create(t->get_element(), empty);
+		new (&p_array_value) auto(nv);
+	}
 	return this;
 }
 #pragma pop_macro("new")
@@ -179,7 +219,20 @@ value& value::operator=(const value& source) {
 void value::make_unique() {
 	if (has_data() && kind == type_data::tk_array) {
 		if (p_array_value.use_count() == 1) return;
-		std::vector<value> vec = *p_array_value.get();
+
+		if (ref_unsync_ptr<value_array> payload = p_array_value->share()) {
+			//Nested arrays may still be aliased from elsewhere, e.g. when put in an array literal
+			for (value& v : payload->list)
+				v.make_unique();
+
+			ref_unsync_ptr<value_array> nv = new value_array();
+			nv->shared = payload;
+			p_array_value = nv;
+			return;
+		}
+
+		//Pinned, copy now
+		std::vector<value> vec = p_array_value->data()->unpack();
 		for (value& v : vec)
 			v.make_unique();
 		this->reset(type, vec);
@@ -191,7 +244,9 @@ void value::append(type_data* t, const value& x) {
 		this->reset(t, std::vector<value>());
 	//make_unique();
 	type = t;
-	p_array_value->push_back(x);
+	value_array* arr = p_array_value->data_unique();
+	if (!arr->push_packed(x))
+		arr->unpack().push_back(x);
 }
 void value::concatenate(const value& x) {
 	if (!has_data() || kind != type_data::tk_array)
@@ -199,34 +254,71 @@ void value::concatenate(const value& x) {
 	//make_unique();
 	if (type->get_element() == nullptr)
 		type = x.type;
-	p_array_value->insert(array_get_end(),
-		x.array_get_begin(), x.array_get_end());
+	if (!x.has_data() || x.kind != type_data::tk_array) return;
+
+	value_array* dst = p_array_value->data_unique();
+	const value_array* src = x.p_array_value->data();
+	if (dst->append_packed(*src)) return;
+
+	if (src == dst) {
+		std::vector<value>& list = dst->unpack();
+		list.reserve(list.size() * 2U);
+		std::copy_n(list.begin(), list.size(), std::back_inserter(list));
+	}
+	else {
+		std::vector<value>& list = dst->unpack();
+		if (src->is_packed()) {
+			size_t count = src->size();
+			list.reserve(list.size() + count);
+			for (size_t i = 0; i < count; ++i)
+				list.push_back(src->get(i));
+		}
+		else list.insert(list.end(), src->list.begin(), src->list.end());
+	}
 }
 
 size_t value::length_as_array() const {
 	if (has_data() && kind == type_data::tk_array)
-		return p_array_value->size();
+		return p_array_value->data()->size();
 	return 0U;
 }
-const value& value::index_as_array(size_t i) const {
-	if (has_data() && kind == type_data::tk_array)
-		return p_array_value->at(i);
-	throw wexception("index_as_array: not an array");
-}
+//Writable element, unpacks the array and detaches the array from copies sharing its buffer
 value& value::index_as_array(size_t i) {
 	if (has_data() && kind == type_data::tk_array)
-		return p_array_value->at(i);
+		return p_array_value->data_unique()->unpack().at(i);
 	throw wexception("index_as_array: not an array");
 }
-std::vector<value>::iterator value::array_get_begin() const {
+//Reads an element by value, leaves packed storage packed
+value value::get_element_as_array(size_t i) const {
 	if (has_data() && kind == type_data::tk_array)
-		return p_array_value->begin();
-	return std::vector<value>::iterator();
+		return p_array_value->data()->get(i);
+	throw wexception("get_element_as_array: not an array");
 }
-std::vector<value>::iterator value::array_get_end() const {
-	if (has_data() && kind == type_data::tk_array)
-		return p_array_value->end();
-	return std::vector<value>::iterator();
+//Writes an element, packed storage stays packed if the type matches
+void value::set_element_as_array(size_t i, const value& x) {
+	if (has_data() && kind == type_data::tk_array) {
+		value_array* arr = p_array_value->data_unique();
+		if (!arr->set_packed(i, x))
+			arr->unpack().at(i) = x;
+		return;
+	}
+	throw wexception("set_element_as_array: not an array");
+}
+const std::wstring* value::as_packed_string() const {
+	if (has_data() && kind == type_data::tk_array) {
+		const value_array* arr = p_array_value->data();
+		if (arr->storage == value_array::st_char)
+			return &arr->chars;
+	}
+	return nullptr;
+}
+value_array* value::pin_as_array() {
+	if (has_data() && kind == type_data::tk_array) {
+		value_array* arr = p_array_value->data_unique();
+		++(arr->pinned);
+		return arr;
+	}
+	return nullptr;
 }
 
 int64_t value::as_int() const {
@@ -310,7 +402,7 @@ bool value::as_boolean() const {
 	if (kind == type_data::tk_pointer)
 		return (ptr_value != nullptr);
 	if (kind == type_data::tk_array)
-		return (p_array_value->size() != 0U);
+		return (p_array_value->data()->size() != 0U);
 	return false;
 }
 std::wstring value::as_string() const {
@@ -326,19 +418,21 @@ std::wstring value::as_string() const {
 	if (kind == type_data::tk_pointer)
 		return StringUtility::Format(L"%08x", (uint32_t)ptr_value);
 	if (kind == type_data::tk_array) {
+		const value_array* arr = p_array_value->data();
 		std::wstring result = L"";
 		if (type_data* elem = type->get_element()) {
 			if (elem->get_kind() == type_data::tk_char) {
-				for (auto itr = p_array_value->begin(); itr != p_array_value->end(); ++itr)
-					result += itr->as_char();
+				if (arr->storage == value_array::st_char)
+					return arr->chars;
+				result.reserve(arr->size());
+				for (size_t i = 0; i < arr->size(); ++i)
+					result += arr->get(i).as_char();
 			}
 			else {
 				result = L"[";
-				auto itr = p_array_value->begin();
-				while (itr != p_array_value->end()) {
-					result += itr->as_string();
-					if ((++itr) == p_array_value->end()) break;
-					result += L",";
+				for (size_t i = 0; i < arr->size(); ++i) {
+					if (i > 0) result += L",";
+					result += arr->is_packed() ? arr->get(i).as_string() : arr->list[i].as_string();
 				}
 				result += L"]";
 			}
@@ -348,9 +442,212 @@ std::wstring value::as_string() const {
 	}
 	return L"(INVALID-TYPE)";
 }
-ref_unsync_ptr<std::vector<value>> value::as_array_ptr() const {
-	if (!has_data()) return nullptr;
-	if (kind == type_data::tk_array)
-		return p_array_value;
-	return nullptr;
+//Copy of the elements, leaves packed storage packed
+std::vector<value> value::as_array() const {
+	std::vector<value> res;
+	if (has_data() && kind == type_data::tk_array) {
+		const value_array* arr = p_array_value->data();
+		if (arr->is_packed()) {
+			size_t count = arr->size();
+			res.resize(count);
+			for (size_t i = 0; i < count; ++i)
+				res[i] = arr->get(i);
+		}
+		else res = arr->list;
+	}
+	return res;
+}
+
+//Buffer to write into, clones the shared payload if other copies still use it
+value_array* value_array::data_unique() {
+	if (shared) {
+		if (shared.use_count() == 1) {
+			swap_buffer(*shared);
+		}
+		else {
+			copy_buffer(*shared);
+
+			//Nested arrays in the copy still point at the payload's, give them handles of their own
+			for (value& v : list)
+				v.make_unique();
+		}
+		shared = nullptr;
+	}
+	return this;
+}
+//Moves the buffer into a payload other copies can share, fails while an element reference to it is held
+ref_unsync_ptr<value_array> value_array::share() {
+	if (shared) return shared;
+	if (pinned > 0) return nullptr;
+	shared = new value_array();
+	shared->swap_buffer(*this);
+	return shared;
+}
+void value_array::copy_buffer(const value_array& src) {
+	storage = src.storage;
+	elem = src.elem;
+	list = src.list;
+	chars = src.chars;
+	ints = src.ints;
+	floats = src.floats;
+}
+void value_array::swap_buffer(value_array& src) {
+	std::swap(storage, src.storage);
+	std::swap(elem, src.elem);
+	list.swap(src.list);
+	chars.swap(src.chars);
+	ints.swap(src.ints);
+	floats.swap(src.floats);
+}
+
+value_array::storage_kind value_array::get_storage(type_data* t) {
+	if (t == nullptr) return st_generic;
+	switch (t->get_kind()) {
+	case type_data::tk_char:
+		return st_char;
+	case type_data::tk_int:
+		return st_int;
+	case type_data::tk_float:
+		return st_float;
+	}
+	return st_generic;
+}
+//Homogeneous char/int/float lists are packed, anything else is kept generic
+value_array* value_array::create(type_data* t, const std::vector<value>& v) {
+	storage_kind kindPacked = get_storage(t);
+	if (kindPacked == st_generic || v.empty())
+		return new value_array(v);
+	for (const value& iVal : v) {
+		if (iVal.get_type() != t)
+			return new value_array(v);
+	}
+
+	value_array* res = new value_array();
+	res->storage = kindPacked;
+	res->elem = t;
+	switch (kindPacked) {
+	case st_char:
+		res->chars.resize(v.size());
+		for (size_t i = 0; i < v.size(); ++i)
+			res->chars[i] = v[i].as_char();
+		break;
+	case st_int:
+		res->ints.resize(v.size());
+		for (size_t i = 0; i < v.size(); ++i)
+			res->ints[i] = v[i].as_int();
+		break;
+	case st_float:
+		res->floats.resize(v.size());
+		for (size_t i = 0; i < v.size(); ++i)
+			res->floats[i] = v[i].as_float();
+		break;
+	}
+	return res;
+}
+size_t value_array::size() const {
+	switch (storage) {
+	case st_char:
+		return chars.size();
+	case st_int:
+		return ints.size();
+	case st_float:
+		return floats.size();
+	}
+	return list.size();
+}
+value value_array::get(size_t i) const {
+	switch (storage) {
+	case st_char:
+		return value(elem, chars.at(i));
+	case st_int:
+		return value(elem, ints.at(i));
+	case st_float:
+		return value(elem, floats.at(i));
+	}
+	return list.at(i);
+}
+//Converts to generic storage in place, every value sharing this store sees the change
+std::vector<value>& value_array::unpack() {
+	if (storage != st_generic) {
+		size_t count = size();
+		list.resize(count);
+		for (size_t i = 0; i < count; ++i)
+			list[i] = get(i);
+
+		storage = st_generic;
+		elem = nullptr;
+		std::wstring().swap(chars);
+		std::vector<int64_t>().swap(ints);
+		std::vector<double>().swap(floats);
+	}
+	return list;
+}
+
+template<typename T> static inline void _append_buffer(T& dst, const T& src) {
+	size_t offset = dst.size();
+	size_t count = src.size();
+	dst.resize(offset + count);
+	std::copy_n(src.begin(), count, dst.begin() + offset);
+}
+bool value_array::set_packed(size_t i, const value& x) {
+	if (storage == st_generic || x.get_type() != elem) return false;
+
+	switch (storage) {
+	case st_char:
+		chars.at(i) = x.as_char();
+		break;
+	case st_int:
+		ints.at(i) = x.as_int();
+		break;
+	case st_float:
+		floats.at(i) = x.as_float();
+		break;
+	}
+	return true;
+}
+bool value_array::push_packed(const value& x) {
+	type_data* t = x.get_type();
+	if (storage == st_generic) {
+		if (!list.empty()) return false;
+		storage_kind kindPacked = get_storage(t);
+		if (kindPacked == st_generic) return false;
+		storage = kindPacked;
+		elem = t;
+	}
+	else if (t != elem) return false;
+
+	switch (storage) {
+	case st_char:
+		chars.push_back(x.as_char());
+		break;
+	case st_int:
+		ints.push_back(x.as_int());
+		break;
+	case st_float:
+		floats.push_back(x.as_float());
+		break;
+	}
+	return true;
+}
+bool value_array::append_packed(const value_array& x) {
+	if (x.size() == 0U) return true;
+	if (storage == st_generic) {
+		if (!list.empty() || !x.is_packed()) return false;
+		storage = x.storage;
+		elem = x.elem;
+	}
+	else if (storage != x.storage || elem != x.elem) return false;
+
+	switch (storage) {
+	case st_char:
+		chars.append(x.chars);
+		break;
+	case st_int:
+		_append_buffer(ints, x.ints);
+		break;
+	case st_float:
+		_append_buffer(floats, x.floats);
+		break;
+	}
+	return true;
 }
\ No newline at end of file
@@ -3,6 +3,8 @@
 #include "../../pch.h"
 
 namespace gstd {
+	class value_array;
+
 #pragma pack(push, 4)
 	class type_data {
 	public:
@@ -38,15 +40,14 @@ namespace gstd {
 		type_data::type_kind kind = type_data::tk_null;
 		type_data* type = nullptr;
 
+		//Only the member matching kind is alive
 		union {
-			struct {
-				double float_value;
-				wchar_t char_value;
-				bool boolean_value;
-				int64_t int_value;
-				value* ptr_value;
-			};
-			ref_unsync_ptr<std::vector<value>> p_array_value;
+			double float_value;
+			wchar_t char_value;
+			bool boolean_value;
+			int64_t int_value;
+			value* ptr_value;
+			ref_unsync_ptr<value_array> p_array_value;
 		};
 	public:
 		value() {}
@@ -73,13 +74,17 @@ namespace gstd {
 		value* reset(type_data* t, bool v);
 		value* reset(type_data* t, value* v);
 		value* reset(type_data* t, std::vector<value>& v);
+		value* reset(type_data* t, std::vector<int64_t>&& v);
+		value* reset(type_data* t, std::vector<double>&& v);
 		value* set(type_data* t, int64_t v);
 		value* set(type_data* t, double v);
 		value* set(type_data* t, wchar_t v);
 		value* set(type_data* t, bool v);
 		value* set(type_data* t, value* v);
 		value* set(type_data* t, std::vector<value>& v);
-		value* set(type_data* t, ref_unsync_ptr<std::vector<value>> v);
+		value* set(type_data* t, std::vector<int64_t>&& v);
+		value* set(type_data* t, std::vector<double>&& v);
+		value* set(type_data* t, ref_unsync_ptr<value_array> v);
 		value* set(type_data* t);
 
 		void make_unique();
@@ -93,13 +98,15 @@ namespace gstd {
 		type_data* get_type() const { return type; }
 
 		size_t length_as_array() const;
-		const value& index_as_array(size_t i) const;
 		value& index_as_array(size_t i);
+		value get_element_as_array(size_t i) const;
+		void set_element_as_array(size_t i, const value& x);
+		const std::wstring* as_packed_string() const;
 
-		std::vector<value>::iterator array_get_begin() const;
-		std::vector<value>::iterator array_get_end() const;
+		//Keeps the buffer from being shared until value_array::unpin, for element references that outlive the call
+		value_array* pin_as_array();
 
-		const value& operator[](size_t i) const { return index_as_array(i); }
+		value operator[](size_t i) const { return get_element_as_array(i); }
 
 		//--------------------------------------------------------------------------
 
@@ -110,7 +117,66 @@ namespace gstd {
 		value* as_ptr() const { return ptr_value; }
 		std::wstring as_string() const;
 
-		ref_unsync_ptr<std::vector<value>> as_array_ptr() const;
+		std::vector<value> as_array() const;
 	};
 #pragma pack(pop)
+
+	//Tag + type + 8-byte payload on 32-bit builds, keep stacks and code streams dense
+	static_assert(sizeof(void*) != 4 || sizeof(value) == 16, "gstd::value is expected to be 16 bytes");
+
+	//Backing store of array values, shared between copies until made unique
+	//	Strings and homogeneous int/float arrays are kept in contiguous buffers,
+	//	and get expanded in place into generic values once an element reference is taken
+	//	Reads by value and writes of the buffer's own element type leave them packed
+	//	make_unique hands the buffer to a copy-on-write payload instead of copying it,
+	//	whichever side writes first clones it back, giving nested arrays payloads of their own
+	class value_array {
+	public:
+		typedef enum : uint8_t {
+			st_generic,
+			st_char,
+			st_int,
+			st_float,
+		} storage_kind;
+	public:
+		storage_kind storage = st_generic;
+		type_data* elem = nullptr;		//Element type of the packed buffer
+
+		std::vector<value> list;
+		std::wstring chars;
+		std::vector<int64_t> ints;
+		std::vector<double> floats;
+
+		uint32_t pinned = 0;					//Element references held on script stacks, the buffer can't be shared meanwhile
+		ref_unsync_ptr<value_array> shared;		//Copy-on-write payload, holds the buffer in place of this
+	public:
+		value_array() {}
+		value_array(const std::vector<value>& v) : list(v) {}
+		value_array(type_data* t, const std::wstring& v) : storage(st_char), elem(t), chars(v) {}
+		value_array(type_data* t, std::vector<int64_t>&& v) : storage(st_int), elem(t), ints(std::move(v)) {}
+		value_array(type_data* t, std::vector<double>&& v) : storage(st_float), elem(t), floats(std::move(v)) {}
+
+		static storage_kind get_storage(type_data* t);
+		static value_array* create(type_data* t, const std::vector<value>& v);
+
+		value_array* data() { return shared ? shared.get() : this; }
+		const value_array* data() const { return shared ? shared.get() : this; }
+		value_array* data_unique();
+		ref_unsync_ptr<value_array> share();
+
+		void unpin() { if (pinned > 0) --pinned; }
+
+		void copy_buffer(const value_array& src);
+		void swap_buffer(value_array& src);
+
+		bool is_packed() const { return storage != st_generic; }
+		size_t size() const;
+
+		value get(size_t i) const;
+		std::vector<value>& unpack();
+
+		bool set_packed(size_t i, const value& x);
+		bool push_packed(const value& x);
+		bool append_packed(const value_array& x);
+	};
 }
\ No newline at end of file
@@ -11,6 +11,7 @@ using namespace gstd;
 //****************************************************************************
 ScriptEngineData::ScriptEngineData() {
 	encoding_ = Encoding::UNKNOWN;
+	bPeepholeEnable_ = true;
 }
 ScriptEngineData::~ScriptEngineData() {}
 void ScriptEngineData::SetSource(std::vector<char>& source) {
@@ -44,15 +45,81 @@ bool ScriptEngineCache::IsExists(const std::wstring& name) {
 	return cache_.find(name) != cache_.end();
 }
 
+static constexpr const char BYTECODE_HEADER[] = "DNHBYTECODE";
+static constexpr size_t BYTECODE_HEADER_SIZE = sizeof(BYTECODE_HEADER)
+	+ sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint64_t) + sizeof(uint32_t) + sizeof(uint32_t);
+
+std::wstring ScriptEngineCache::_GetBytecodePath(uint64_t key) {
+	return pathBytecode_ + StringUtility::Format(L"%016llx.dat", key);
+}
+bool ScriptEngineCache::LoadBytecode(ScriptEngineData* data, uint64_t key, std::vector<function>* listFunc) {
+	if (!IsBytecodeEnabled()) return false;
+
+	std::vector<char> bytecode;
+	{
+		Lock lock(lockBytecode_);
+
+		File file(_GetBytecodePath(key));
+		if (!file.IsExists() || !file.Open()) return false;
+
+		size_t sizeFile = file.GetSize();
+		if (sizeFile < BYTECODE_HEADER_SIZE) return false;
+
+		char header[sizeof(BYTECODE_HEADER)];
+		file.Read(header, sizeof(BYTECODE_HEADER));
+		if (memcmp(header, BYTECODE_HEADER, sizeof(BYTECODE_HEADER)) != 0) return false;
+
+		if (file.ReadValue<uint64_t>() != GAME_VERSION_NUM) return false;
+		if (file.ReadValue<uint32_t>() != script_engine::BYTECODE_VERSION) return false;
+		if (file.ReadValue<uint64_t>() != key) return false;
+		if (file.ReadValue<uint32_t>() != data->GetSource().size()) return false;
+
+		size_t sizeBytecode = file.ReadValue<uint32_t>();
+		if (sizeFile != BYTECODE_HEADER_SIZE + sizeBytecode) return false;
+
+		bytecode.resize(sizeBytecode);
+		if (file.Read(bytecode.data(), sizeBytecode) != sizeBytecode) return false;
+	}
+
+	unique_ptr<script_engine> engine(new script_engine());
+	if (!engine->load_bytecode(bytecode, listFunc)) return false;
+
+	data->SetEngine(std::move(engine));
+	return true;
+}
+void ScriptEngineCache::SaveBytecode(ScriptEngineData* data, uint64_t key) {
+	if (!IsBytecodeEnabled()) return;
+
+	std::vector<char> bytecode;
+	if (!data->GetEngine()->save_bytecode(bytecode)) return;
+
+	Lock lock(lockBytecode_);
+
+	std::wstring path = _GetBytecodePath(key);
+	File::CreateFileDirectory(path);
+
+	File file(path);
+	if (!file.Open(File::AccessType::WRITEONLY)) {
+		Logger::WriteTop(StringUtility::Format(L"ScriptEngineCache: Failed to write bytecode cache [%s]", 
+			path.c_str()));
+		return;
+	}
+
+	file.Write((LPVOID)BYTECODE_HEADER, sizeof(BYTECODE_HEADER));
+	file.WriteValue<uint64_t>(GAME_VERSION_NUM);
+	file.WriteValue<uint32_t>(script_engine::BYTECODE_VERSION);
+	file.WriteValue<uint64_t>(key);
+	file.WriteValue<uint32_t>(data->GetSource().size());
+	file.WriteValue<uint32_t>(bytecode.size());
+	file.Write(bytecode.data(), bytecode.size());
+	file.Close();
+}
+
 //****************************************************************************
 //ScriptClientBase
 //****************************************************************************
-static const std::vector<function> commonFunction = {
-	//Script functions
-	{ "GetScriptArgument", ScriptClientBase::Func_GetScriptArgument, 1 },
-	{ "GetScriptArgumentCount", ScriptClientBase::Func_GetScriptArgumentCount, 0 },
-	{ "SetScriptResult", ScriptClientBase::Func_SetScriptResult, 1 },
-
+//Only touch their arguments, isolated scripts may call these outside the main thread
+static const std::vector<function> threadSafeFunction = {
 	//Floating point functions
 	{ "Float_Classify", ScriptClientBase::Float_Classify, 1 },
 	{ "Float_IsNan", ScriptClientBase::Float_IsNan, 1 },
@@ -73,13 +140,13 @@ static const std::vector<function> commonFunction = {
 	{ "gamma", ScriptClientBase::Func_Gamma, 1 },
 
 	//Math functions: Trigonometry
-	{ "cos", ScriptClientBase::Func_Cos, 1 },
-	{ "sin", ScriptClientBase::Func_Sin, 1 },
+	{ "cos", ScriptClientBase::Func_Cos, 1, command_kind::pc_inline_cos },
+	{ "sin", ScriptClientBase::Func_Sin, 1, command_kind::pc_inline_sin },
 	{ "tan", ScriptClientBase::Func_Tan, 1 },
 	{ "sincos", ScriptClientBase::Func_SinCos, 1 },
 	{ "cossin", ScriptClientBase::Func_CosSin, 1 },
-	{ "rcos", ScriptClientBase::Func_RCos, 1 },
-	{ "rsin", ScriptClientBase::Func_RSin, 1 },
+	{ "rcos", ScriptClientBase::Func_RCos, 1, command_kind::pc_inline_rcos },
+	{ "rsin", ScriptClientBase::Func_RSin, 1, command_kind::pc_inline_rsin },
 	{ "rtan", ScriptClientBase::Func_RTan, 1 },
 	{ "rsincos", ScriptClientBase::Func_RSinCos, 1 },
 	{ "rcossin", ScriptClientBase::Func_RCosSin, 1 },
@@ -94,11 +161,11 @@ static const std::vector<function> commonFunction = {
 	{ "acos", ScriptClientBase::Func_Acos, 1 },
 	{ "asin", ScriptClientBase::Func_Asin, 1 },
 	{ "atan", ScriptClientBase::Func_Atan, 1 },
-	{ "atan2", ScriptClientBase::Func_Atan2, 2 },
+	{ "atan2", ScriptClientBase::Func_Atan2, 2, command_kind::pc_inline_atan2 },
 	{ "racos", ScriptClientBase::Func_RAcos, 1 },
 	{ "rasin", ScriptClientBase::Func_RAsin, 1 },
 	{ "ratan", ScriptClientBase::Func_RAtan, 1 },
-	{ "ratan2", ScriptClientBase::Func_RAtan2, 2 },
+	{ "ratan2", ScriptClientBase::Func_RAtan2, 2, command_kind::pc_inline_ratan2 },
 	{ "asec", ScriptClientBase::Func_Asec, 1 },
 	{ "acsc", ScriptClientBase::Func_Acsc, 1 },
 	{ "acot", ScriptClientBase::Func_Acot, 1 },
@@ -139,11 +206,11 @@ static const std::vector<function> commonFunction = {
 
 	//Math functions: Extra
 	{ "exp", ScriptClientBase::Func_Exp, 1 },
-	{ "sqrt", ScriptClientBase::Func_Sqrt, 1 },
+	{ "sqrt", ScriptClientBase::Func_Sqrt, 1, command_kind::pc_inline_sqrt },
 	{ "cbrt", ScriptClientBase::Func_Cbrt, 1 },
 	{ "nroot", ScriptClientBase::Func_NRoot, 2 },
-	{ "hypot", ScriptClientBase::Func_Hypot, 2 },
-	{ "distance", ScriptClientBase::Func_Distance, 4 },
+	{ "hypot", ScriptClientBase::Func_Hypot, 2, command_kind::pc_inline_hypot },
+	{ "distance", ScriptClientBase::Func_Distance, 4, command_kind::pc_inline_distance },
 	{ "distancesq", ScriptClientBase::Func_DistanceSq, 4 },
 	{ "dottheta", ScriptClientBase::Func_GapAngle<false>, 4 },
 	{ "rdottheta", ScriptClientBase::Func_GapAngle<true>, 4 },
@@ -152,25 +219,6 @@ static const std::vector<function> commonFunction = {
 	{ "CartesianToPolar", ScriptClientBase::Func_CartesianToPolar<false>, 2 },
 	{ "CartesianToPolarR", ScriptClientBase::Func_CartesianToPolar<true>, 2 },
 
-	//Random
-	{ "rand", ScriptClientBase::Func_Rand, 2 },
-	{ "rand_int", ScriptClientBase::Func_RandI, 2 },
-	{ "prand", ScriptClientBase::Func_RandEff, 2 },
-	{ "prand_int", ScriptClientBase::Func_RandEffI, 2 },
-	{ "rand_array", ScriptClientBase::Func_RandArray, 3 },
-	{ "rand_int_array", ScriptClientBase::Func_RandArrayI, 3 },
-	{ "prand_array", ScriptClientBase::Func_RandEffArray, 3 },
-	{ "prand_int_array", ScriptClientBase::Func_RandEffArrayI, 3 },
-	{ "choose", ScriptClientBase::Func_Choose, 1 },
-	{ "pchoose", ScriptClientBase::Func_ChooseEff, 1 },
-	{ "shuffle", ScriptClientBase::Func_Shuffle, 1 },
-	{ "pshuffle", ScriptClientBase::Func_ShuffleEff, 1 },
-	{ "psrand", ScriptClientBase::Func_RandEffSet, 1 },
-	{ "count_rand", ScriptClientBase::Func_GetRandCount, 0 },
-	{ "count_prand", ScriptClientBase::Func_GetRandEffCount, 0 },
-	{ "reset_count_rand", ScriptClientBase::Func_ResetRandCount, 0 },
-	{ "reset_count_prand", ScriptClientBase::Func_ResetRandEffCount, 0 },
-
 	//Interpolation
 	{ "Interpolate_Linear", ScriptClientBase::Func_Interpolate<Math::Lerp::Linear>, 3 },
 	{ "Interpolate_Smooth", ScriptClientBase::Func_Interpolate<Math::Lerp::Smooth>, 3 },
@@ -253,7 +301,31 @@ static const std::vector<function> commonFunction = {
 	{ "GetPoints_Ellipse", ScriptClientBase::Func_GetPoints_Ellipse, 7 },
 	{ "GetPoints_EquidistantEllipse", ScriptClientBase::Func_GetPoints_EquidistantEllipse, 7 },
 	{ "GetPoints_RegularPolygon", ScriptClientBase::Func_GetPoints_RegularPolygon, 7 },
+};
+static const std::vector<function> commonFunction = {
+	//Script functions
+	{ "GetScriptArgument", ScriptClientBase::Func_GetScriptArgument, 1 },
+	{ "GetScriptArgumentCount", ScriptClientBase::Func_GetScriptArgumentCount, 0 },
+	{ "SetScriptResult", ScriptClientBase::Func_SetScriptResult, 1 },
 
+	//Random
+	{ "rand", ScriptClientBase::Func_Rand, 2 },
+	{ "rand_int", ScriptClientBase::Func_RandI, 2 },
+	{ "prand", ScriptClientBase::Func_RandEff, 2 },
+	{ "prand_int", ScriptClientBase::Func_RandEffI, 2 },
+	{ "rand_array", ScriptClientBase::Func_RandArray, 3 },
+	{ "rand_int_array", ScriptClientBase::Func_RandArrayI, 3 },
+	{ "prand_array", ScriptClientBase::Func_RandEffArray, 3 },
+	{ "prand_int_array", ScriptClientBase::Func_RandEffArrayI, 3 },
+	{ "choose", ScriptClientBase::Func_Choose, 1 },
+	{ "pchoose", ScriptClientBase::Func_ChooseEff, 1 },
+	{ "shuffle", ScriptClientBase::Func_Shuffle, 1 },
+	{ "pshuffle", ScriptClientBase::Func_ShuffleEff, 1 },
+	{ "psrand", ScriptClientBase::Func_RandEffSet, 1 },
+	{ "count_rand", ScriptClientBase::Func_GetRandCount, 0 },
+	{ "count_prand", ScriptClientBase::Func_GetRandEffCount, 0 },
+	{ "reset_count_rand", ScriptClientBase::Func_ResetRandCount, 0 },
+	{ "reset_count_prand", ScriptClientBase::Func_ResetRandEffCount, 0 },
 
 	//Path utilities
 	{ "GetParentScriptDirectory", ScriptClientBase::Func_GetParentScriptDirectory, 0 },
@@ -285,6 +357,10 @@ static const std::vector<function> commonFunction = {
 	{ "RaiseError", ScriptClientBase::Func_RaiseError, 1 },
 	{ "RaiseMessageWindow", ScriptClientBase::Func_RaiseMessageWindow, 2 },
 	{ "RaiseMessageWindow", ScriptClientBase::Func_RaiseMessageWindow, 3 },	//Overloaded
+	{ "StartScriptProfiler", ScriptClientBase::Func_StartScriptProfiler, 1 },
+	{ "StopScriptProfiler", ScriptClientBase::Func_StopScriptProfiler, 0 },
+	{ "SaveScriptProfile", ScriptClientBase::Func_SaveScriptProfile, 1 },
+	{ "GetScriptProfileSummary", ScriptClientBase::Func_GetScriptProfileSummary, 0 },
 
 	//Common data
 	{ "SetCommonData", ScriptClientBase::Func_SetCommonData, 2 },
@@ -373,6 +449,12 @@ ScriptClientBase::ScriptClientBase() {
 	engine_.reset(new ScriptEngineData());
 	machine_ = nullptr;
 
+	instructionBudget_ = 0;
+	bInstructionBudgetYield_ = false;
+	countOverrunFrame_ = 0;
+
+	callGate_ = nullptr;
+
 	mainThreadID_ = -1;
 	idScript_ = ID_SCRIPT_FREE;
 
@@ -388,6 +470,7 @@ ScriptClientBase::ScriptClientBase() {
 		mtEffect_->Initialize(((seed ^ 0xf27ea021) << 11) ^ ((seed ^ 0x8b56c1b5) >> 11));
 	}
 
+	_AddFunction(&threadSafeFunction);
 	_AddFunction(&commonFunction);
 	_AddConstant(&commonConstant);
 	{
@@ -475,9 +558,57 @@ std::vector<char> ScriptClientBase::_ParseScriptSource(std::vector<char>& source
 	return scriptLoader.GetResult();
 }
 bool ScriptClientBase::_CreateEngine() {
-	unique_ptr<script_engine> engine(new script_engine(engine_->GetSource(), &func_, &const_));
+	bool bBytecode = cache_ != nullptr && cache_->IsBytecodeEnabled();
+
+	uint64_t key = 0;
+	if (bBytecode) {
+		key = _GetBytecodeKey();
+		if (cache_->LoadBytecode(engine_.get(), key, &func_))
+			return true;
+	}
+
+	unique_ptr<script_engine> engine(new script_engine(engine_->GetSource(), &func_, &const_,
+		engine_->IsPeepholeEnable()));
 	engine_->SetEngine(std::move(engine));
-	return !engine_->GetEngine()->get_error();
+
+	bool res = !engine_->GetEngine()->get_error();
+	if (bBytecode && res)
+		cache_->SaveBytecode(engine_.get(), key);
+	return res;
+}
+static uint64_t _HashBytes(uint64_t hash, const void* data, size_t size) {
+	//FNV-1a
+	const uint8_t* pData = (const uint8_t*)data;
+	for (size_t i = 0; i < size; ++i) {
+		hash ^= pData[i];
+		hash *= 0x100000001b3ui64;
+	}
+	return hash;
+}
+//Hash of everything the compiled code depends on: the expanded source, the compiler version and settings,
+//	and the native function and constant tables of this script type
+uint64_t ScriptClientBase::_GetBytecodeKey() {
+	uint64_t hash = 0xcbf29ce484222325ui64;
+
+	std::vector<char>& source = engine_->GetSource();
+	hash = _HashBytes(hash, source.data(), source.size());
+
+	uint32_t version = script_engine::BYTECODE_VERSION;
+	bool bPeephole = engine_->IsPeepholeEnable();
+	hash = _HashBytes(hash, &version, sizeof(version));
+	hash = _HashBytes(hash, &bPeephole, sizeof(bPeephole));
+
+	for (const function& iFunc : func_) {
+		hash = _HashBytes(hash, iFunc.name, strlen(iFunc.name) + 1);
+		hash = _HashBytes(hash, &iFunc.argc, sizeof(iFunc.argc));
+		hash = _HashBytes(hash, &iFunc.intrinsic, sizeof(iFunc.intrinsic));
+	}
+	for (const constant& iConst : const_) {
+		hash = _HashBytes(hash, iConst.name, strlen(iConst.name) + 1);
+		hash = _HashBytes(hash, &iConst.type, sizeof(iConst.type));
+		hash = _HashBytes(hash, &iConst.data, sizeof(iConst.data));
+	}
+	return hash;
 }
 bool ScriptClientBase::SetSourceFromFile(std::wstring path) {
 	path = PathProperty::GetUnique(path);
@@ -535,6 +666,10 @@ void ScriptClientBase::Compile() {
 		_RaiseErrorFromMachine();
 	}
 	machine_->data = this;
+	machine_->set_profiler(profiler_.get());
+	machine_->set_instruction_budget(instructionBudget_, bInstructionBudgetYield_);
+	machine_->budget_callback = _OnInstructionBudgetOverrun;
+	machine_->set_call_gate(callGate_);
 }
 
 void ScriptClientBase::Reset() {
@@ -573,6 +708,17 @@ bool ScriptClientBase::Run(std::map<std::string, script_block*>::iterator target
 	}
 	return true;
 }
+bool ScriptClientBase::Run(script_block* target) {
+	if (bError_) return false;
+
+	machine_->call(target);
+
+	if (machine_->get_error()) {
+		bError_ = true;
+		_RaiseErrorFromMachine();
+	}
+	return true;
+}
 bool ScriptClientBase::IsEventExists(const std::string& name, std::map<std::string, script_block*>::iterator& res) {
 	if (bError_) {
 		if (machine_ && machine_->get_error())
@@ -583,10 +729,188 @@ bool ScriptClientBase::IsEventExists(const std::string& name, std::map<std::stri
 	}
 	return machine_->has_event(name, res);
 }
+//Like IsEventExists, but by interned ID (script_engine::get_event_id)
+script_block* ScriptClientBase::GetEvent(uint32_t id) {
+	if (bError_) {
+		if (machine_ && machine_->get_error())
+			_RaiseErrorFromMachine();
+		else if (engine_->GetEngine()->get_error())
+			_RaiseErrorFromEngine();
+		return nullptr;
+	}
+	return machine_->get_event(id);
+}
+//Doesn't raise errors, false if the script isn't compiled yet
+bool ScriptClientBase::HasEvent(uint32_t id) {
+	script_engine* engine = engine_->GetEngine().get();
+	return engine != nullptr && engine->get_event(id) != nullptr;
+}
 size_t ScriptClientBase::GetThreadCount() {
 	if (machine_ == nullptr) return 0;
 	return machine_->get_thread_count();
 }
+
+//Instructions allowed between ResetInstructionCount calls, 0 for no limit
+void ScriptClientBase::SetInstructionBudget(uint64_t budget, bool bYield) {
+	instructionBudget_ = budget;
+	bInstructionBudgetYield_ = bYield;
+	countOverrunFrame_ = 0;
+	if (machine_)
+		machine_->set_instruction_budget(budget, bYield);
+}
+//Returns the instructions executed since the last call
+uint64_t ScriptClientBase::ResetInstructionCount() {
+	if (machine_ == nullptr) return 0;
+	countOverrunFrame_ = machine_->is_budget_overrun() ? countOverrunFrame_ + 1 : 0;
+	return machine_->reset_instruction_count();
+}
+//Native calls of this script go through the gate, nullptr to call them directly
+void ScriptClientBase::SetCallGate(script_call_gate* gate) {
+	callGate_ = gate;
+	if (machine_)
+		machine_->set_call_gate(gate);
+}
+//Base operations and threadSafeFunction, these may run on any thread
+bool ScriptClientBase::IsThreadSafeFunction(dnh_func_callback_t func) {
+	static const std::set<dnh_func_callback_t> setFunc = []() {
+		std::set<dnh_func_callback_t> res;
+		for (const function& iFunc : *parser::get_base_operations())
+			res.insert(iFunc.func);
+		for (const function& iFunc : threadSafeFunction)
+			res.insert(iFunc.func);
+		return res;
+	}();
+	return setFunc.find(func) != setFunc.end();
+}
+void ScriptClientBase::_OnInstructionBudgetOverrun(script_machine* machine, int line) {
+	ScriptClientBase* script = reinterpret_cast<ScriptClientBase*>(machine->data);
+	if (script == nullptr) return;
+
+	//Only the first frame of a run of overruns is logged, the log window shows the rest
+	if (script->countOverrunFrame_ > 0) return;
+
+	Logger::WriteTop(StringUtility::Format(L"Script exceeded its instruction budget of %llu: %s (at %s)%s",
+		script->instructionBudget_, PathProperty::GetFileName(script->GetPath()).c_str(),
+		script->_GetSourceLocation(line).c_str(),
+		script->bInstructionBudgetYield_ ? L", tasks are suspended until the next frame" : L""));
+}
+
+//Profiler, samples are taken every [interval] script instructions
+void ScriptClientBase::StartProfiler(uint32_t interval) {
+	profiler_.reset(new script_profiler(interval));
+	if (machine_)
+		machine_->set_profiler(profiler_.get());
+}
+//Stops sampling, the collected samples are kept
+void ScriptClientBase::StopProfiler() {
+	if (machine_)
+		machine_->set_profiler(nullptr);
+}
+std::wstring ScriptClientBase::_GetSourceLocation(int line) {
+	ScriptFileLineMap::Entry* entry = engine_->GetScriptFileLineMap()->GetEntry(line);
+
+	std::wstring path = engine_->GetPath();
+	if (entry) {
+		line = entry->lineEndOriginal_ - (entry->lineEnd_ - line);
+		path = entry->path_;
+	}
+	return StringUtility::Format(L"%s:%d", PathProperty::GetFileName(path).c_str(), line);
+}
+std::string ScriptClientBase::_GetProfileFrameName(script_block* block) {
+	script_engine* engine = engine_->GetEngine().get();
+	if (block == engine->main_block)
+		return "main";
+	for (auto& [name, event] : engine->events) {
+		if (event == block)
+			return "@" + name;
+	}
+	if (block->name.size() == 0)
+		return "(async)";
+	return block->name;
+}
+//Writes the samples as collapsed stacks ("main;@MainLoop;Fire;stage.dnh:40 12"), for flame graph tools
+bool ScriptClientBase::SaveProfile(const std::wstring& path) {
+	if (profiler_ == nullptr) return false;
+
+	std::map<script_block*, std::string> mapName;
+	std::map<int, std::string> mapLocation;
+
+	std::string text;
+	for (auto& [key, count] : profiler_->samples) {
+		for (script_block* iBlock : key.stack) {
+			auto itrName = mapName.find(iBlock);
+			if (itrName == mapName.end())
+				itrName = mapName.insert({ iBlock, _GetProfileFrameName(iBlock) }).first;
+			text += itrName->second + ";";
+		}
+
+		auto itrLocation = mapLocation.find(key.line);
+		if (itrLocation == mapLocation.end()) {
+			std::string location = StringUtility::ConvertWideToMulti(_GetSourceLocation(key.line));
+			std::replace(location.begin(), location.end(), ';', '_');
+			itrLocation = mapLocation.insert({ key.line, location }).first;
+		}
+		text += itrLocation->second + StringUtility::Format(" %llu\n", count);
+	}
+
+	File::CreateFileDirectory(path);
+
+	File file(path);
+	if (!file.Open(File::AccessType::WRITEONLY)) return false;
+	file.Write(text.data(), text.size());
+	file.Close();
+	return true;
+}
+//One line per sub/function/task, by self samples: "name, self, inclusive, hottest line"
+std::vector<std::wstring> ScriptClientBase::GetProfileSummary() {
+	std::vector<std::wstring> res;
+	if (profiler_ == nullptr) return res;
+
+	struct Entry {
+		uint64_t countSelf = 0;
+		uint64_t countTotal = 0;
+		std::map<int, uint64_t> mapLine;
+	};
+	std::map<script_block*, Entry> mapEntry;
+
+	for (auto& [key, count] : profiler_->samples) {
+		if (key.stack.size() == 0) continue;
+
+		Entry& leaf = mapEntry[key.stack.back()];
+		leaf.countSelf += count;
+		leaf.mapLine[key.line] += count;
+
+		//Recursive calls only count once
+		for (size_t i = 0; i < key.stack.size(); ++i) {
+			script_block* block = key.stack[i];
+			if (std::find(key.stack.begin(), key.stack.begin() + i, block) == key.stack.begin() + i)
+				mapEntry[block].countTotal += count;
+		}
+	}
+
+	std::vector<std::pair<script_block*, Entry*>> listEntry;
+	for (auto& [block, entry] : mapEntry)
+		listEntry.push_back({ block, &entry });
+	std::stable_sort(listEntry.begin(), listEntry.end(),
+		[](const std::pair<script_block*, Entry*>& a, const std::pair<script_block*, Entry*>& b) {
+			return a.second->countSelf > b.second->countSelf;
+		});
+
+	for (auto& [block, entry] : listEntry) {
+		std::wstring hotLine = L"-";
+		if (entry->mapLine.size() > 0) {
+			auto itrHot = std::max_element(entry->mapLine.begin(), entry->mapLine.end(),
+				[](const std::pair<const int, uint64_t>& a, const std::pair<const int, uint64_t>& b) {
+					return a.second < b.second;
+				});
+			hotLine = _GetSourceLocation(itrHot->first);
+		}
+		res.push_back(StringUtility::Format(L"%s, %llu, %llu, %s",
+			StringUtility::ConvertMultiToWide(_GetProfileFrameName(block)).c_str(),
+			entry->countSelf, entry->countTotal, hotLine.c_str()));
+	}
+	return res;
+}
 void ScriptClientBase::SetArgumentValue(value v, int index) {
 	if (listValueArg_.size() <= index) {
 		listValueArg_.resize(index + 1);
@@ -1158,7 +1482,7 @@ value ScriptClientBase::Func_Choose(script_machine* machine, int argc, const val
 	int64_t index = script->mt_->GetReal(0, size + 0.9999999);
 	++randCalls_;
 
-	return val->index_as_array(index);
+	return val->get_element_as_array(index);
 }
 value ScriptClientBase::Func_ChooseEff(script_machine* machine, int argc, const value* argv) {
 	BaseFunction::_null_check(machine, argv, argc);
@@ -1177,7 +1501,7 @@ value ScriptClientBase::Func_ChooseEff(script_machine* machine, int argc, const
 	int64_t index = script->mtEffect_->GetReal(0, size + 0.9999999);
 	++prandCalls_;
 
-	return val->index_as_array(index);
+	return val->get_element_as_array(index);
 }
 value ScriptClientBase::Func_Shuffle(script_machine* machine, int argc, const value* argv) {
 	BaseFunction::_null_check(machine, argv, argc);
@@ -1202,7 +1526,7 @@ value ScriptClientBase::Func_Shuffle(script_machine* machine, int argc, const va
 	std::vector<value> arrOld(size);
 
 	for (size_t i = 0; i < size; ++i)
-		arrOld[i] = val->index_as_array(i);
+		arrOld[i] = val->get_element_as_array(i);
 
 	for (size_t i = 0; i < size; ++i) {
 		int64_t index = 0;
@@ -1241,7 +1565,7 @@ value ScriptClientBase::Func_ShuffleEff(script_machine* machine, int argc, const
 	std::vector<value> arrOld(size);
 
 	for (size_t i = 0; i < size; ++i)
-		arrOld[i] = val->index_as_array(i);
+		arrOld[i] = val->get_element_as_array(i);
 
 	for (size_t i = 0; i < size; ++i) {
 		int64_t index = 0;
@@ -1294,9 +1618,9 @@ static value _ScriptValueLerp(script_machine* machine, const value* v1, const va
 			std::vector<value> resArr;
 			resArr.resize(v1->length_as_array());
 			for (size_t i = 0; i < v1->length_as_array(); ++i) {
-				const value* a1 = &(*v1)[i];
-				const value* a2 = &(*v2)[i];
-				resArr[i] = _ScriptValueLerp(machine, a1, a2, vx, lerpFunc);
+				value a1 = v1->get_element_as_array(i);
+				value a2 = v2->get_element_as_array(i);
+				resArr[i] = _ScriptValueLerp(machine, &a1, &a2, vx, lerpFunc);
 			}
 
 			res.reset(v1->get_type(), resArr);
@@ -1460,7 +1784,7 @@ value ScriptClientBase::Func_Interpolate_X_Array(script_machine* machine, int ar
 		return value();
 	}
 
-	std::vector<value> arr = *(val->as_array_ptr());
+	std::vector<value> arr = val->as_array();
 	double x = argv[1].as_float();
 
 	size_t len = arr.size();
@@ -2237,6 +2561,28 @@ value ScriptClientBase::Func_RaiseMessageWindow(script_machine* machine, int arg
 	return ScriptClientBase::CreateIntValue(res);
 }
 
+value ScriptClientBase::Func_StartScriptProfiler(script_machine* machine, int argc, const value* argv) {
+	ScriptClientBase* script = reinterpret_cast<ScriptClientBase*>(machine->data);
+	int64_t interval = argv->as_int();
+	script->StartProfiler((uint32_t)std::clamp<int64_t>(interval, 1, UINT32_MAX));
+	return value();
+}
+value ScriptClientBase::Func_StopScriptProfiler(script_machine* machine, int argc, const value* argv) {
+	ScriptClientBase* script = reinterpret_cast<ScriptClientBase*>(machine->data);
+	script->StopProfiler();
+	return value();
+}
+value ScriptClientBase::Func_SaveScriptProfile(script_machine* machine, int argc, const value* argv) {
+	ScriptClientBase* script = reinterpret_cast<ScriptClientBase*>(machine->data);
+	std::wstring path = argv->as_string();
+	bool res = script->SaveProfile(path);
+	return ScriptClientBase::CreateBooleanValue(res);
+}
+value ScriptClientBase::Func_GetScriptProfileSummary(script_machine* machine, int argc, const value* argv) {
+	ScriptClientBase* script = reinterpret_cast<ScriptClientBase*>(machine->data);
+	return ScriptClientBase::CreateStringArrayValue(script->GetProfileSummary());
+}
+
 //共通関数：共通データ
 value ScriptClientBase::Func_SetCommonData(script_machine* machine, int argc, const value* argv) {
 	ScriptClientBase* script = reinterpret_cast<ScriptClientBase*>(machine->data);
@@ -2821,6 +3167,10 @@ void ScriptLoader::_ParseInclude() {
 					_DumpRes();
 					bReread = true;
 				}
+				else if (directiveType == L"nopeephole") {
+					//Compile without superinstructions, to compare timings against the peephole pass
+					script_->engine_->SetPeepholeEnable(false);
+				}
 			}
 		}
 		if (bReread) {
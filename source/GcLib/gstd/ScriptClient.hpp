@@ -50,6 +50,8 @@ namespace gstd {
 
 		unique_ptr<script_engine> engine_;
 		ScriptFileLineMap mapLine_;
+
+		bool bPeepholeEnable_;
 	public:
 		ScriptEngineData();
 		virtual ~ScriptEngineData();
@@ -65,6 +67,9 @@ namespace gstd {
 		unique_ptr<script_engine>& GetEngine() { return engine_; }
 
 		ScriptFileLineMap* GetScriptFileLineMap() { return &mapLine_; }
+
+		void SetPeepholeEnable(bool b) { bPeepholeEnable_ = b; }
+		bool IsPeepholeEnable() { return bPeepholeEnable_; }
 	};
 
 	//*******************************************************************
@@ -73,6 +78,12 @@ namespace gstd {
 	class ScriptEngineCache {
 	protected:
 		std::map<std::wstring, shared_ptr<ScriptEngineData>> cache_;
+
+		//Compiled bytecode kept on disk between runs, keyed by ScriptClientBase::_GetBytecodeKey
+		std::wstring pathBytecode_;
+		gstd::CriticalSection lockBytecode_;
+
+		std::wstring _GetBytecodePath(uint64_t key);
 	public:
 		ScriptEngineCache();
 
@@ -85,6 +96,12 @@ namespace gstd {
 		const std::map<std::wstring, shared_ptr<ScriptEngineData>>& GetMap() { return cache_; }
 
 		bool IsExists(const std::wstring& name);
+
+		void SetBytecodeDirectory(const std::wstring& dir) { pathBytecode_ = dir; }
+		bool IsBytecodeEnabled() { return pathBytecode_.size() > 0; }
+
+		bool LoadBytecode(ScriptEngineData* data, uint64_t key, std::vector<function>* listFunc);
+		void SaveBytecode(ScriptEngineData* data, uint64_t key);
 	};
 
 	//*******************************************************************
@@ -107,6 +124,13 @@ namespace gstd {
 
 		shared_ptr<ScriptEngineData> engine_;
 		unique_ptr<script_machine> machine_;
+		unique_ptr<script_profiler> profiler_;
+
+		uint64_t instructionBudget_;
+		bool bInstructionBudgetYield_;
+		uint32_t countOverrunFrame_;	//Consecutive frames that went over the budget
+
+		script_call_gate* callGate_;
 
 		std::vector<gstd::function> func_;
 		std::vector<gstd::constant> const_;
@@ -131,9 +155,13 @@ namespace gstd {
 		void _RaiseErrorFromMachine();
 		void _RaiseError(int line, const std::wstring& message);
 		std::wstring _GetErrorLineSource(int line);
+		std::wstring _GetSourceLocation(int line);
+		std::string _GetProfileFrameName(script_block* block);
+		static void _OnInstructionBudgetOverrun(script_machine* machine, int line);
 
 		virtual std::vector<char> _ParseScriptSource(std::vector<char>& source);
 		virtual bool _CreateEngine();
+		uint64_t _GetBytecodeKey();
 
 		std::wstring _ExtendPath(std::wstring path);
 	public:
@@ -161,7 +189,10 @@ namespace gstd {
 		virtual bool Run();
 		virtual bool Run(const std::string& target);
 		virtual bool Run(std::map<std::string, script_block*>::iterator target);
+		virtual bool Run(script_block* target);
 		bool IsEventExists(const std::string& name, std::map<std::string, script_block*>::iterator& res);
+		script_block* GetEvent(uint32_t id);
+		bool HasEvent(uint32_t id);
 		void RaiseError(const std::wstring& error) { _RaiseError(machine_->get_error_line(), error); }
 		void RaiseError(const std::string& error) {
 			_RaiseError(machine_->get_error_line(), 
@@ -171,6 +202,21 @@ namespace gstd {
 		int64_t GetScriptID() { return idScript_; }
 		size_t GetThreadCount();
 
+		void StartProfiler(uint32_t interval);
+		void StopProfiler();
+		script_profiler* GetProfiler() { return profiler_.get(); }
+		bool SaveProfile(const std::wstring& path);
+		std::vector<std::wstring> GetProfileSummary();
+
+		void SetInstructionBudget(uint64_t budget, bool bYield);
+		uint64_t GetInstructionBudget() { return instructionBudget_; }
+		uint64_t ResetInstructionCount();
+		uint32_t GetOverrunFrameCount() { return countOverrunFrame_; }
+
+		void SetCallGate(script_call_gate* gate);
+		script_call_gate* GetCallGate() { return callGate_; }
+		static bool IsThreadSafeFunction(dnh_func_callback_t func);
+
 		void AddArgumentValue(value v) { listValueArg_.push_back(v); }
 		void SetArgumentValue(value v, int index = 0);
 		value GetResultValue() { return valueRes_; }
@@ -408,6 +454,10 @@ namespace gstd {
 		static value Func_WriteLog(script_machine* machine, int argc, const value* argv);
 		static value Func_RaiseError(script_machine* machine, int argc, const value* argv);
 		DNH_FUNCAPI_DECL_(Func_RaiseMessageWindow);
+		DNH_FUNCAPI_DECL_(Func_StartScriptProfiler);
+		DNH_FUNCAPI_DECL_(Func_StopScriptProfiler);
+		DNH_FUNCAPI_DECL_(Func_SaveScriptProfile);
+		DNH_FUNCAPI_DECL_(Func_GetScriptProfileSummary);
 
 		//Script common data
 		static value Func_SetCommonData(script_machine* machine, int argc, const value* argv);
@@ -457,17 +507,16 @@ namespace gstd {
 	}
 	template<typename T>
 	value ScriptClientBase::CreateFloatArrayValue(const T* ptrList, size_t count) {
-		type_data* type_float = script_type_manager::get_float_type();
 		type_data* type_arr = script_type_manager::get_float_array_type();
 		if (ptrList && count > 0) {
-			std::vector<value> res_arr;
+			std::vector<double> res_arr;
 			res_arr.resize(count);
 			for (size_t iVal = 0U; iVal < count; ++iVal) {
-				res_arr[iVal] = value(type_float, (double)(ptrList[iVal]));
+				res_arr[iVal] = (double)(ptrList[iVal]);
 			}
 
 			value res;
-			res.reset(type_arr, res_arr);
+			res.reset(type_arr, std::move(res_arr));
 			return res;
 		}
 		return value(type_arr, std::wstring());
@@ -482,17 +531,16 @@ namespace gstd {
 	}
 	template<typename T>
 	value ScriptClientBase::CreateIntArrayValue(const T* ptrList, size_t count) {
-		type_data* type_int = script_type_manager::get_int_type();
 		type_data* type_arr = script_type_manager::get_int_array_type();
 		if (ptrList && count > 0) {
-			std::vector<value> res_arr;
+			std::vector<int64_t> res_arr;
 			res_arr.resize(count);
 			for (size_t iVal = 0U; iVal < count; ++iVal) {
-				res_arr[iVal] = value(type_int, (int64_t)(ptrList[iVal]));
+				res_arr[iVal] = (int64_t)(ptrList[iVal]);
 			}
 
 			value res;
-			res.reset(type_arr, res_arr);
+			res.reset(type_arr, std::move(res_arr));
 			return res;
 		}
 		return value(type_arr, std::wstring());
@@ -113,6 +113,177 @@ StaticLock::~StaticLock() {
 	mtx_->unlock();
 }
 
+//*******************************************************************
+//ThreadPool
+//*******************************************************************
+ThreadPool* ThreadPool::thisBase_ = nullptr;
+thread_local int ThreadPool::indexCurrentWorker_ = -1;
+ThreadPool::ThreadPool(size_t countWorker) {
+	if (countWorker == 0) {
+		//The thread calling ParallelFor also runs tasks
+		countWorker = std::max(std::thread::hardware_concurrency(), 2U) - 1U;
+	}
+
+	generation_ = 0;
+	bStop_ = false;
+	countTaskRun_ = 0;
+	countSteal_ = 0;
+
+	listWorker_.resize(countWorker);
+	for (auto& worker : listWorker_)
+		worker.reset(new Worker());
+	for (size_t i = 0; i < countWorker; ++i)
+		listWorker_[i]->thread = std::thread(&ThreadPool::_Run, this, (int)i);
+
+	if (thisBase_ == nullptr)
+		thisBase_ = this;
+}
+ThreadPool::~ThreadPool() {
+	{
+		std::lock_guard<std::mutex> lock(mtxSleep_);
+		bStop_ = true;
+	}
+	cvSleep_.notify_all();
+	for (auto& worker : listWorker_) {
+		if (worker->thread.joinable())
+			worker->thread.join();
+	}
+	listWorker_.clear();
+
+	if (thisBase_ == this)
+		thisBase_ = nullptr;
+}
+ThreadPool* ThreadPool::GetBase() {
+	if (thisBase_ == nullptr) {
+		//Never destroyed, joining workers during static destruction can deadlock on exit
+		static ThreadPool* poolDefault = new ThreadPool();
+		return poolDefault;
+	}
+	return thisBase_;
+}
+void ThreadPool::_Run(int index) {
+	indexCurrentWorker_ = index;
+
+	while (true) {
+		uint64_t generation = 0;
+		{
+			std::lock_guard<std::mutex> lock(mtxSleep_);
+			if (bStop_) break;
+			generation = generation_;
+		}
+
+		Task task;
+		if (_PopLocal(index, task) || _Steal(index, task)) {
+			_Execute(task);
+			continue;
+		}
+
+		//Nothing runnable, sleep until more tasks get pushed
+		std::unique_lock<std::mutex> lock(mtxSleep_);
+		cvSleep_.wait(lock, [&]() { return bStop_ || generation_ != generation; });
+	}
+
+	indexCurrentWorker_ = -1;
+}
+void ThreadPool::_Push(size_t index, const Task& task) {
+	Worker* worker = listWorker_[index].get();
+	std::lock_guard<std::mutex> lock(worker->mtx);
+	worker->deque.push_back(task);
+}
+bool ThreadPool::_PopLocal(int index, Task& task) {
+	if (index < 0) return false;
+
+	//The owner takes from the back, thieves take from the front
+	Worker* worker = listWorker_[index].get();
+	std::lock_guard<std::mutex> lock(worker->mtx);
+	if (worker->deque.empty()) return false;
+	task = worker->deque.back();
+	worker->deque.pop_back();
+	return true;
+}
+bool ThreadPool::_Steal(int index, Task& task) {
+	size_t countWorker = listWorker_.size();
+	size_t start = index < 0 ? 0 : (size_t)index + 1U;
+	for (size_t i = 0; i < countWorker; ++i) {
+		size_t iVictim = (start + i) % countWorker;
+		if ((int)iVictim == index) continue;
+
+		Worker* worker = listWorker_[iVictim].get();
+		std::lock_guard<std::mutex> lock(worker->mtx);
+		if (worker->deque.empty() || worker->deque.front().bPinned) continue;
+		task = worker->deque.front();
+		worker->deque.pop_front();
+		++countSteal_;
+		return true;
+	}
+	return false;
+}
+void ThreadPool::_Execute(const Task& task) {
+	try {
+		(*task.job->func)(task.begin, task.end);
+	}
+	catch (...) {
+		//Errors unhandled
+	}
+	++countTaskRun_;
+	task.job->countRemaining.fetch_sub(1, std::memory_order_release);
+}
+void ThreadPool::ParallelFor(size_t countLoop, size_t grain, const RangeFunction& func, Partition partition) {
+	if (countLoop == 0) return;
+
+	size_t countWorker = listWorker_.size();
+
+	Job job;
+	job.func = &func;
+
+	std::vector<Task> listTask;
+	if (partition == PARTITION_STATIC) {
+		size_t countPartition = std::min(countLoop, countWorker);
+		listTask.resize(countPartition);
+		for (size_t i = 0; i < countPartition; ++i) {
+			Task& task = listTask[i];
+			task.job = &job;
+			task.begin = countLoop * i / countPartition;
+			task.end = countLoop * (i + 1U) / countPartition;
+			task.bPinned = true;
+		}
+	}
+	else {
+		if (grain == 0)
+			grain = std::max<size_t>(countLoop / ((countWorker + 1U) * 4U), 1U);
+		size_t countChunk = (countLoop + grain - 1U) / grain;
+		listTask.resize(countChunk);
+		for (size_t i = 0; i < countChunk; ++i) {
+			Task& task = listTask[i];
+			task.job = &job;
+			task.begin = i * grain;
+			task.end = std::min(task.begin + grain, countLoop);
+			task.bPinned = false;
+		}
+	}
+	job.countRemaining = listTask.size();
+
+	//Contiguous chunks go to the same worker, pushed in reverse so the owner starts from the lowest
+	for (size_t i = listTask.size(); i > 0; --i) {
+		size_t iTask = i - 1U;
+		_Push(iTask * countWorker / listTask.size(), listTask[iTask]);
+	}
+	{
+		std::lock_guard<std::mutex> lock(mtxSleep_);
+		++generation_;
+	}
+	cvSleep_.notify_all();
+
+	int index = indexCurrentWorker_;
+	while (job.countRemaining.load(std::memory_order_acquire) > 0) {
+		Task task;
+		if (_PopLocal(index, task) || _Steal(index, task))
+			_Execute(task);
+		else
+			std::this_thread::yield();
+	}
+}
+
 //*******************************************************************
 //ThreadSignal
 //*******************************************************************
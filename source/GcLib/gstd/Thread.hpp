@@ -73,6 +73,69 @@ namespace gstd {
 		~StaticLock();
 	};
 
+	//****************************************************************************
+	//ThreadPool
+	//	Persistent worker threads, each with its own work-stealing task deque
+	//****************************************************************************
+	class ThreadPool {
+	public:
+		typedef std::function<void(size_t, size_t)> RangeFunction;
+
+		typedef enum : uint8_t {
+			PARTITION_DYNAMIC,		//Chunks may be stolen by any idle thread
+			PARTITION_STATIC,		//One contiguous range per worker, always run on that worker
+		} Partition;
+	private:
+		struct Job {
+			const RangeFunction* func;
+			std::atomic<size_t> countRemaining;
+		};
+		struct Task {
+			Job* job;
+			size_t begin;
+			size_t end;
+			bool bPinned;
+		};
+		struct Worker {
+			std::mutex mtx;
+			std::deque<Task> deque;
+			std::thread thread;
+		};
+	private:
+		static ThreadPool* thisBase_;
+		static thread_local int indexCurrentWorker_;
+
+		std::vector<unique_ptr<Worker>> listWorker_;
+
+		std::mutex mtxSleep_;
+		std::condition_variable cvSleep_;
+		uint64_t generation_;
+		bool bStop_;
+
+		std::atomic<uint64_t> countTaskRun_;
+		std::atomic<uint64_t> countSteal_;
+
+		void _Run(int index);
+		void _Push(size_t index, const Task& task);
+		bool _PopLocal(int index, Task& task);
+		bool _Steal(int index, Task& task);
+		void _Execute(const Task& task);
+	public:
+		ThreadPool(size_t countWorker = 0);
+		virtual ~ThreadPool();
+
+		//Creates a default pool on first use if the application hasn't made one
+		static ThreadPool* GetBase();
+
+		//Calls func(begin, end) over [0, countLoop) in chunks of at most grain iterations, 0 picks one automatically
+		//	Returns once every chunk has finished, the calling thread helps out in the meantime
+		void ParallelFor(size_t countLoop, size_t grain, const RangeFunction& func, Partition partition = PARTITION_DYNAMIC);
+
+		size_t GetWorkerCount() const { return listWorker_.size(); }
+		uint64_t GetTaskRunCount() const { return countTaskRun_; }
+		uint64_t GetStealCount() const { return countSteal_; }
+	};
+
 	//****************************************************************************
 	//ThreadSignal
 	//	Wrapper for thread event signaling
@@ -74,6 +74,9 @@ namespace gstd {
 		//Computes reciprocal of vector
 		static __forceinline __m128 Rcp(const __m128& x);
 
+		//Compares a[i] <= b[i], bit i of the result is set if true
+		static __forceinline int CompareLE(const __m128& a, const __m128& b);
+
 		//[add] double vector a and b
 		static __forceinline __m128d Add(const __m128d& a, const __m128d& b);
 		//[subtract] double vector a and b
@@ -511,6 +514,20 @@ namespace gstd {
 
 	//---------------------------------------------------------------------
 
+	int Vectorize::CompareLE(const __m128& a, const __m128& b) {
+		int res = 0;
+#ifndef __L_MATH_VECTORIZE
+		for (int i = 0; i < 4; ++i)
+			res |= (a.m128_f32[i] <= b.m128_f32[i]) << i;
+#else
+		//SSE
+		res = _mm_movemask_ps(_mm_cmple_ps(a, b));
+#endif
+		return res;
+	}
+
+	//---------------------------------------------------------------------
+
 	__m128i Vectorize::Max(const __m128i& a, const __m128i& b) {
 		__m128i res;
 #ifndef __L_MATH_VECTORIZE
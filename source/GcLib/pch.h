@@ -113,6 +113,7 @@
 
 #include <array>
 #include <list>
+#include <deque>
 #include <vector>
 #include <set>
 #include <map>
@@ -124,7 +125,9 @@
 #include <memory>
 #include <algorithm>
 #include <iterator>
+#include <functional>
 #include <future>
+#include <shared_mutex>
 
 #include <fstream>
 #include <sstream>
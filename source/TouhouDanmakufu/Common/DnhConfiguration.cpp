@@ -56,6 +56,9 @@ DnhConfiguration::DnhConfiguration() {
 
 	bEnableUnfocusedProcessing_ = false;
 
+	scriptInstructionBudget_ = 0;
+	bScriptInstructionBudgetYield_ = false;
+
 	LoadConfigFile();
 	_LoadDefinitionFile();
 }
@@ -95,6 +98,12 @@ bool DnhConfiguration::_LoadDefinitionFile() {
 		bEnableUnfocusedProcessing_ = str == L"true" ? true : StringUtility::ToInteger(str);
 	}
 
+	scriptInstructionBudget_ = std::max(prop.GetInteger(L"script.instruction.budget", 0), 0);
+	{
+		std::wstring str = prop.GetString(L"script.instruction.budget.yield", L"false");
+		bScriptInstructionBudgetYield_ = str == L"true" ? true : StringUtility::ToInteger(str);
+	}
+
 	{
 		if (prop.HasProperty(L"window.size.list")) {
 			std::wstring strList = prop.GetString(L"window.size.list", L"");
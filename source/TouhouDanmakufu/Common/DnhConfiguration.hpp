@@ -26,6 +26,9 @@ public:
 	LONG screenHeight_;
 	bool bEnableUnfocusedProcessing_;
 
+	uint64_t scriptInstructionBudget_;
+	bool bScriptInstructionBudgetYield_;
+
 	uint32_t fpsStandard_;
 	int fpsType_;
 	int fastModeSpeed_;
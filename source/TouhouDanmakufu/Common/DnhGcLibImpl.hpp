@@ -18,6 +18,7 @@ public:
 	static const std::wstring& GetStgScriptRootDirectory();
 	static const std::wstring& GetStgDefaultScriptDirectory();
 	static const std::wstring& GetPlayerScriptRootDirectory();
+	static const std::wstring& GetScriptCacheDirectory();
 
 	static std::wstring GetReplaySaveDirectory(const std::wstring& scriptPath);
 	static std::wstring GetCommonDataPath(const std::wstring& scriptPath, const std::wstring& area);
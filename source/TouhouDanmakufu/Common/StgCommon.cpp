@@ -3,6 +3,46 @@
 #include "StgCommon.hpp"
 #include "StgSystem.hpp"
 
+//****************************************************************************
+//StgObjectPool
+//****************************************************************************
+StgObjectPool::StgObjectPool(size_t sizeBlock) {
+	sizeBlock_ = sizeBlock;
+	idThread_ = GetCurrentThreadId();
+	countHit_ = 0;
+	countMiss_ = 0;
+}
+StgObjectPool::~StgObjectPool() {
+	for (void* ptr : listFree_)
+		::operator delete(ptr);
+}
+void* StgObjectPool::Allocate(size_t size) {
+	assert(GetCurrentThreadId() == idThread_);
+
+	//Derived classes inherit operator new but don't fit the blocks
+	if (size != sizeBlock_)
+		return ::operator new(size);
+
+	if (listFree_.size() > 0) {
+		void* res = listFree_.back();
+		listFree_.pop_back();
+		++countHit_;
+		return res;
+	}
+	++countMiss_;
+	return ::operator new(size);
+}
+void StgObjectPool::Release(void* ptr, size_t size) {
+	if (ptr == nullptr) return;
+	assert(GetCurrentThreadId() == idThread_);
+
+	if (size != sizeBlock_) {
+		::operator delete(ptr);
+		return;
+	}
+	listFree_.push_back(ptr);
+}
+
 //****************************************************************************
 //StgMoveObject
 //****************************************************************************
@@ -54,26 +94,23 @@ void StgMoveObject::Copy(StgMoveObject* src) {
 	frameMove_ = src->frameMove_;
 	framePattern_ = src->framePattern_;
 
-	mapPattern_.clear();
-	for (auto& iPair : src->mapPattern_) {
-		std::list<ref_unsync_ptr<StgMovePattern>> listPattern;
-		for (auto& iPattern : iPair.second) {
-			auto pattern = _ClonePattern(iPattern.get(), this);
-			listPattern.push_back(pattern);
-		}
-		mapPattern_[iPair.first] = listPattern;
-	}
+	listReservedPattern_.clear();
+	listReservedPattern_.reserve(src->listReservedPattern_.size());
+	for (auto& iPair : src->listReservedPattern_)
+		listReservedPattern_.push_back(std::make_pair(iPair.first, _ClonePattern(iPair.second.get(), this)));
 }
 void StgMoveObject::Move() {
 	++frameMove_;
-	if (mapPattern_.size() > 0) {
-		auto itr = mapPattern_.begin();
-		while (framePattern_ >= itr->first) {
-			for (auto& ipPattern : itr->second)
-				_AttachReservedPattern(ipPattern);
-			itr = mapPattern_.erase(itr);
-			if (mapPattern_.size() == 0) break;
+	if (listReservedPattern_.size() > 0) {
+		size_t countDue = 0;
+		while (countDue < listReservedPattern_.size()
+			&& listReservedPattern_[countDue].first <= framePattern_)
+		{
+			_AttachReservedPattern(listReservedPattern_[countDue].second);
+			++countDue;
 		}
+		if (countDue > 0)
+			listReservedPattern_.erase(listReservedPattern_.begin(), listReservedPattern_.begin() + countDue);
 		if (pattern_ == nullptr)
 			pattern_ = new StgMovePattern_Angle(this);
 	}
@@ -91,6 +128,17 @@ void StgMoveObject::_Move() {
 		}
 	}
 }
+//Whether this frame's _Move only reads and writes this object
+bool StgMoveObject::_IsMoveIsolated() {
+	if (listOwnedParent_.size() > 0) return false;
+
+	//Move would create a default pattern from the shared pool
+	if (pattern_ == nullptr && listReservedPattern_.size() > 0) return false;
+
+	//A reserved pattern due this frame may activate relative to other objects
+	if (listReservedPattern_.size() > 0 && listReservedPattern_.front().first <= framePattern_) return false;
+	return true;
+}
 void StgMoveObject::_AttachReservedPattern(ref_unsync_ptr<StgMovePattern> pattern) {
 	pattern->Activate(pattern_.get());
 	pattern_ = pattern;
@@ -100,7 +148,14 @@ void StgMoveObject::AddPattern(uint32_t frameDelay, ref_unsync_ptr<StgMovePatter
 		_AttachReservedPattern(pattern);
 	else {
 		uint32_t frame = frameDelay + framePattern_;
-		mapPattern_[frame].push_back(pattern);
+
+		//Usually only a handful are queued, reserve them all at once
+		if (listReservedPattern_.capacity() == 0)
+			listReservedPattern_.reserve(4);
+
+		auto itrInsert = std::upper_bound(listReservedPattern_.begin(), listReservedPattern_.end(), frame,
+			[](uint32_t f, const std::pair<uint32_t, ref_unsync_ptr<StgMovePattern>>& p) { return f < p.first; });
+		listReservedPattern_.insert(itrInsert, std::make_pair(frame, pattern));
 	}
 }
 
@@ -595,6 +650,26 @@ void StgMovePattern::_RegisterShotDataID() {
 	}
 }
 
+#ifdef __L_MATH_VECTORIZE
+//Picks b where mask is set, a elsewhere
+static __forceinline __m128d _MoveSelect(const __m128d& a, const __m128d& b, const __m128d& mask) {
+	return _mm_or_pd(_mm_and_pd(mask, b), _mm_andnot_pd(mask, a));
+}
+//Same as the scalar "if (accel != 0) { value += accel; clamp to max }" of the move patterns, for both lanes
+static __forceinline __m128d _MoveAccelerate(const __m128d& value, const __m128d& accel, const __m128d& max) {
+	const __m128d zero = _mm_setzero_pd();
+	__m128d sum = _mm_add_pd(value, accel);
+
+	//Operands are swapped so that NaNs resolve the same way as std::min(sum, max) and std::max(sum, max)
+	__m128d res = _MoveSelect(sum, _mm_min_pd(max, sum), _mm_cmpgt_pd(accel, zero));
+	res = _MoveSelect(res, _mm_max_pd(max, sum), _mm_cmplt_pd(accel, zero));
+	res = _MoveSelect(sum, res, _mm_cmpneq_pd(max, _mm_set1_pd(StgMovePattern::UNCAPPED)));
+
+	//Leave the value untouched when accel is 0, as -0 + 0 is not -0
+	return _MoveSelect(value, res, _mm_cmpneq_pd(accel, zero));
+}
+#endif
+
 //****************************************************************************
 //StgMovePattern_Angle
 //****************************************************************************
@@ -610,6 +685,12 @@ StgMovePattern_Angle::StgMovePattern_Angle(StgMoveObject* target) : StgMovePatte
 	objRelative_ = ref_unsync_weak_ptr<StgMoveObject>();
 }
 
+void* StgMovePattern_Angle::operator new(size_t size) {
+	return StgShotManager::AllocatePooled(StgShotManager::POOL_PATTERN_ANGLE, size);
+}
+void StgMovePattern_Angle::operator delete(void* ptr, size_t size) {
+	StgShotManager::ReleasePooled(StgShotManager::POOL_PATTERN_ANGLE, ptr, size);
+}
 void StgMovePattern_Angle::CopyFrom(StgMovePattern* _src) {
 	StgMovePattern::CopyFrom(_src);
 	auto src = (StgMovePattern_Angle*)_src;
@@ -626,6 +707,18 @@ void StgMovePattern_Angle::CopyFrom(StgMovePattern* _src) {
 void StgMovePattern_Angle::Move() {
 	double angle = angDirection_;
 
+#ifdef __L_MATH_VECTORIZE
+	//Speed and angular velocity in one pair of lanes, bit-identical to the scalar path
+	{
+		double res[2];
+		__m128d v_value = _mm_set_pd(angularVelocity_, speed_);
+		__m128d v_accel = _mm_set_pd(angularAcceleration_, acceleration_);
+		__m128d v_max = _mm_set_pd(angularMaxVelocity_, maxSpeed_);
+		_mm_storeu_pd(res, _MoveAccelerate(v_value, v_accel, v_max));
+		speed_ = res[0];
+		angularVelocity_ = res[1];
+	}
+#else
 	if (acceleration_ != 0) {
 		speed_ += acceleration_;
 		if (maxSpeed_ != UNCAPPED) {
@@ -644,12 +737,25 @@ void StgMovePattern_Angle::Move() {
 				angularVelocity_ = std::max(angularVelocity_, angularMaxVelocity_);
 		}
 	}
+#endif
 	if (angularVelocity_ != 0) {
 		SetDirectionAngle(angle + angularVelocity_);
 	}
 
-	target_->SetPositionX(fma(speed_, c_, target_->GetPositionX()));
-	target_->SetPositionY(fma(speed_, s_, target_->GetPositionY()));
+#ifdef __L_MATH_VECTORIZE
+	if (SystemUtility::IsCpuSupportFMA()) {
+		double pos[2];
+		__m128d v_pos = _mm_set_pd(target_->GetPositionY(), target_->GetPositionX());
+		_mm_storeu_pd(pos, _mm_fmadd_pd(_mm_set1_pd(speed_), _mm_set_pd(s_, c_), v_pos));
+		target_->SetPositionX(pos[0]);
+		target_->SetPositionY(pos[1]);
+	}
+	else
+#endif
+	{
+		target_->SetPositionX(fma(speed_, c_, target_->GetPositionX()));
+		target_->SetPositionY(fma(speed_, s_, target_->GetPositionY()));
+	}
 
 	++frameWork_;
 }
@@ -791,6 +897,12 @@ StgMovePattern_XY::StgMovePattern_XY(StgMoveObject* target) : StgMovePattern(tar
 	maxSpeedY_ = 0;
 }
 
+void* StgMovePattern_XY::operator new(size_t size) {
+	return StgShotManager::AllocatePooled(StgShotManager::POOL_PATTERN_XY, size);
+}
+void StgMovePattern_XY::operator delete(void* ptr, size_t size) {
+	StgShotManager::ReleasePooled(StgShotManager::POOL_PATTERN_XY, ptr, size);
+}
 void StgMovePattern_XY::CopyFrom(StgMovePattern* _src) {
 	StgMovePattern::CopyFrom(_src);
 	auto src = (StgMovePattern_XY*)_src;
@@ -802,6 +914,24 @@ void StgMovePattern_XY::CopyFrom(StgMovePattern* _src) {
 }
 
 void StgMovePattern_XY::Move() {
+#ifdef __L_MATH_VECTORIZE
+	//Both axes in one pair of lanes, bit-identical to the scalar path
+	{
+		double res[2];
+		__m128d v_value = _mm_set_pd(s_, c_);
+		__m128d v_accel = _mm_set_pd(accelerationY_, accelerationX_);
+		__m128d v_max = _mm_set_pd(maxSpeedY_, maxSpeedX_);
+		v_value = _MoveAccelerate(v_value, v_accel, v_max);
+		_mm_storeu_pd(res, v_value);
+		c_ = res[0];
+		s_ = res[1];
+
+		__m128d v_pos = _mm_set_pd(target_->GetPositionY(), target_->GetPositionX());
+		_mm_storeu_pd(res, _mm_add_pd(v_pos, v_value));
+		target_->SetPositionX(res[0]);
+		target_->SetPositionY(res[1]);
+	}
+#else
 	if (accelerationX_ != 0) {
 		c_ += accelerationX_;
 		if (maxSpeedX_ != UNCAPPED) {
@@ -823,6 +953,7 @@ void StgMovePattern_XY::Move() {
 
 	target_->SetPositionX(target_->GetPositionX() + c_);
 	target_->SetPositionY(target_->GetPositionY() + s_);
+#endif
 
 	++frameWork_;
 }
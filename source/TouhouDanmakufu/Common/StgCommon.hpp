@@ -18,6 +18,32 @@ class StgSystemInformation;
 class StgMovePattern;
 class StgMoveParent;
 
+//*******************************************************************
+//StgObjectPool
+//	Free list of same-sized blocks, recycled through a class's operator new/delete.
+//	Owned by StgShotManager, see StgShotManager::AllocatePooled.
+//	Not thread-safe, only allocate and free from the thread that built the pool.
+//*******************************************************************
+class StgObjectPool {
+	size_t sizeBlock_;
+	std::vector<void*> listFree_;
+	DWORD idThread_;
+
+	uint64_t countHit_;
+	uint64_t countMiss_;
+public:
+	StgObjectPool(size_t sizeBlock);
+	StgObjectPool(const StgObjectPool&) = delete;
+	~StgObjectPool();
+
+	void* Allocate(size_t size);
+	void Release(void* ptr, size_t size);
+
+	size_t GetFreeCount() { return listFree_.size(); }
+	uint64_t GetHitCount() { return countHit_; }
+	uint64_t GetMissCount() { return countMiss_; }
+};
+
 //*******************************************************************
 //StgMoveObject
 //*******************************************************************
@@ -40,9 +66,12 @@ protected:
 	std::vector<ref_unsync_weak_ptr<StgMoveParent>> listOwnedParent_;
 
 	uint32_t framePattern_;
-	std::map<uint32_t, std::list<ref_unsync_ptr<StgMovePattern>>> mapPattern_;
+	//Reserved patterns sorted by activation frame, same-frame patterns keep their insertion order
+	std::vector<std::pair<uint32_t, ref_unsync_ptr<StgMovePattern>>> listReservedPattern_;
+
 	virtual void _Move();
 	void _AttachReservedPattern(ref_unsync_ptr<StgMovePattern> pattern);
+	bool _IsMoveIsolated();
 public:
 	StgMoveObject(StgStageController* stageController);
 	virtual ~StgMoveObject();
@@ -269,6 +298,9 @@ protected:
 public:
 	StgMovePattern_Angle(StgMoveObject* target);
 
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
 	virtual void CopyFrom(StgMovePattern* src);
 	virtual StgMovePattern* CreateCopy(StgMoveObject* target) {
 		return new StgMovePattern_Angle(target);
@@ -320,6 +352,9 @@ protected:
 public:
 	StgMovePattern_XY(StgMoveObject* target);
 
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
 	virtual void CopyFrom(StgMovePattern* src);
 	virtual StgMovePattern* CreateCopy(StgMoveObject* target) {
 		return new StgMovePattern_XY(target);
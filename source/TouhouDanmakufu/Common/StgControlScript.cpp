@@ -1155,6 +1155,7 @@ bool ScriptInfoPanel::_AddedLogger(HWND hTab) {
 	wndScript_.AddColumn(64, 4, L"Status");
 	wndScript_.AddColumn(80, 5, L"Task Count");
 	wndScript_.AddColumn(80, 6, L"CPU Time (μs)");
+	wndScript_.AddColumn(160, 7, L"Instructions");
 
 	wndSplitter_.Create(hWnd_, WSplitter::TYPE_HORIZONTAL);
 	wndSplitter_.SetRatioY(0.5f);
@@ -1344,6 +1345,11 @@ void ScriptInfoPanel::Update(StgSystemController* systemController) {
 					wndScript_.SetText(iScript, 4, status);
 					wndScript_.SetText(iScript, 5, StringUtility::Format(L"%u", script->GetThreadCount()));
 					wndScript_.SetText(iScript, 6, StringUtility::Format(L"%u", script->GetScriptRunTime()));
+
+					std::wstring strInstruction = StringUtility::Format(L"%llu", script->GetInstructionCount());
+					if (uint32_t countOverrun = script->GetOverrunFrameCount())
+						strInstruction += StringUtility::Format(L" (over budget, %u frames)", countOverrun);
+					wndScript_.SetText(iScript, 7, strInstruction);
 				};
 
 				ScriptManager* manager = vecScriptManager[selectedIndex];
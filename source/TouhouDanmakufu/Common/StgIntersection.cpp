@@ -125,11 +125,22 @@ void StgIntersectionManager::Work() {
 
 	size_t totalCheck = 0;
 	size_t totalTarget = 0;
+	size_t totalRectTest = 0;
+	size_t totalBatchCircle = 0;
+	stdch::nanoseconds timeBroadphase{ 0 };
 	for (auto itr = listSpace_.begin(); itr != listSpace_.end(); itr++) {
 		StgIntersectionSpace* space = *itr;
 
 		size_t currentCheck = 0;
+		auto timeStart = SystemUtility::GetCpuTime();
 		auto listCheck = space->CreateIntersectionCheckList(this, currentCheck);
+		timeBroadphase += SystemUtility::GetCpuTime() - timeStart;
+
+		totalTarget += space->GetTargetCount();
+		totalRectTest += space->GetRectTestCount();
+
+		_TestCheckList(listCheck, currentCheck);
+		totalBatchCircle += batchCircle_.GetCount();
 
 		for (size_t iCheck = 0; iCheck < currentCheck; iCheck++) {
 			auto& cTargetPair = listCheck->at(iCheck);
@@ -138,7 +149,7 @@ void StgIntersectionManager::Work() {
 			StgIntersectionTarget* targetB = cTargetPair.second;
 			if (targetA == nullptr || targetB == nullptr) continue;
 
-			if (IsIntersected(targetA, targetB)) {
+			if (listCheckResult_[iCheck]) {
 				ref_unsync_weak_ptr<StgIntersectionObject>& ptrA = targetA->GetObject();
 				ref_unsync_weak_ptr<StgIntersectionObject>& ptrB = targetB->GetObject();
 				{
@@ -161,6 +172,7 @@ void StgIntersectionManager::Work() {
 		totalCheck += currentCheck;
 		space->ClearTarget();
 	}
+	listTargetHold_.clear();
 
 	//_ArrangePool();
 
@@ -173,7 +185,10 @@ void StgIntersectionManager::Work() {
 			StringUtility::Format(L"Used=%4d, Cached=%4d, Total=%4d, Check=%4d", countUsed, countCache, countUsed + countCache, totalCheck));
 		*/
 		logger->SetInfo(9, L"Intersection count",
-			StringUtility::Format(L"Total=%4d, Check=%4d", totalTarget, totalCheck));
+			StringUtility::Format(L"Total=%4d, Check=%4d, Batched=%4d", totalTarget, totalCheck, totalBatchCircle));
+		logger->SetInfo(10, L"Intersection broadphase",
+			StringUtility::Format(L"Tested=%6u, Time=%.3fms", totalRectTest,
+				stdch::duration<double, std::milli>(timeBroadphase).count()));
 	}
 }
 void StgIntersectionManager::RenderVisualizer() {
@@ -186,7 +201,30 @@ void StgIntersectionManager::RenderVisualizer() {
 }
 void StgIntersectionManager::AddTarget(ref_unsync_ptr<StgIntersectionTarget> target) {
 	if (target == nullptr) return;
-	//if (auto obj = target->GetObject()) {
+
+	bool bEraseShot = false;
+	StgIntersectionTarget::Type type = target->GetTargetType();
+	if (type == StgIntersectionTarget::TYPE_PLAYER_SHOT || type == StgIntersectionTarget::TYPE_PLAYER_SPELL) {
+		if (auto obj = target->GetObject()) {
+			if (type == StgIntersectionTarget::TYPE_PLAYER_SHOT) {
+				StgShotObject* shot = (StgShotObject*)obj.get();
+				if (shot)
+					bEraseShot = shot->IsEraseShot();
+			}
+			else if (type == StgIntersectionTarget::TYPE_PLAYER_SPELL) {
+				StgPlayerSpellObject* spell = (StgPlayerSpellObject*)obj.get();
+				if (spell)
+					bEraseShot = spell->IsEraseShot();
+			}
+		}
+	}
+
+	//Nothing else may be keeping this target alive, hold it until the frame's checks are done
+	listTargetHold_.push_back(target);
+	AddTarget(target.get(), bEraseShot);
+}
+void StgIntersectionManager::AddTarget(StgIntersectionTarget* target, bool bEraseShot) {
+	if (target == nullptr) return;
 	{
 		StgIntersectionTarget::Type type = target->GetTargetType();
 		switch (type) {
@@ -199,23 +237,8 @@ void StgIntersectionManager::AddTarget(ref_unsync_ptr<StgIntersectionTarget> tar
 		case StgIntersectionTarget::TYPE_PLAYER_SPELL:
 		{
 			listSpace_[SPACE_PLAYERSHOT_ENEMY]->RegistTargetA(target);
-			if (auto obj = target->GetObject()) {
-				bool bEraseShot = false;
-
-				if (type == StgIntersectionTarget::TYPE_PLAYER_SHOT) {
-					StgShotObject* shot = (StgShotObject*)obj.get();
-					if (shot)
-						bEraseShot = shot->IsEraseShot();
-				}
-				else if (type == StgIntersectionTarget::TYPE_PLAYER_SPELL) {
-					StgPlayerSpellObject* spell = (StgPlayerSpellObject*)obj.get();
-					if (spell)
-						bEraseShot = spell->IsEraseShot();
-				}
-
-				if (bEraseShot)
-					listSpace_[SPACE_PLAYERSHOT_ENEMYSHOT]->RegistTargetA(target);
-			}
+			if (bEraseShot)
+				listSpace_[SPACE_PLAYERSHOT_ENEMYSHOT]->RegistTargetA(target);
 			break;
 		}
 		case StgIntersectionTarget::TYPE_ENEMY:
@@ -224,7 +247,8 @@ void StgIntersectionManager::AddTarget(ref_unsync_ptr<StgIntersectionTarget> tar
 				listSpace_[SPACE_PLAYER_ENEMY]->RegistTargetB(target);
 				listSpace_[SPACE_PLAYERSHOT_ENEMY]->RegistTargetB(target);
 
-				if (auto circle = ref_unsync_ptr<StgIntersectionTarget_Circle>::Cast(target)) {
+				if (target->GetShape() == StgIntersectionTarget::SHAPE_CIRCLE) {
+					StgIntersectionTarget_Circle* circle = (StgIntersectionTarget_Circle*)target;
 					ref_unsync_weak_ptr<StgEnemyObject> objEnemy = ref_unsync_weak_ptr<StgEnemyObject>::Cast(obj);
 					if (objEnemy) {
 						POINT pos = { (int)circle->GetCircle().GetX(), (int)circle->GetCircle().GetY() };
@@ -255,7 +279,8 @@ void StgIntersectionManager::AddEnemyTargetToShot(ref_unsync_ptr<StgIntersection
 	switch (type) {
 	case StgIntersectionTarget::TYPE_ENEMY:
 	{
-		listSpace_[SPACE_PLAYERSHOT_ENEMY]->RegistTargetB(target);
+		listTargetHold_.push_back(target);
+		listSpace_[SPACE_PLAYERSHOT_ENEMY]->RegistTargetB(target.get());
 
 		if (auto circle = ref_unsync_ptr<StgIntersectionTarget_Circle>::Cast(target)) {
 			if (ref_unsync_ptr<StgIntersectionObject> obj = target->GetObject().Lock()) {
@@ -281,7 +306,8 @@ void StgIntersectionManager::AddEnemyTargetToPlayer(ref_unsync_ptr<StgIntersecti
 	switch (type) {
 	case StgIntersectionTarget::TYPE_ENEMY:
 	{
-		listSpace_[SPACE_PLAYER_ENEMY]->RegistTargetB(target);
+		listTargetHold_.push_back(target);
+		listSpace_[SPACE_PLAYER_ENEMY]->RegistTargetB(target.get());
 		break;
 	}
 	}
@@ -324,7 +350,37 @@ lab_fail:
 	return false;
 }
 
-void StgIntersectionManager::AddVisualization(ref_unsync_ptr<StgIntersectionTarget>& target) {
+void StgIntersectionManager::_TestCheckList(std::vector<StgIntersectionSpace::TargetCheckListPair>* listCheck, size_t count) {
+	if (listCheckResult_.size() < count)
+		listCheckResult_.resize(count);
+	batchCircle_.Clear();
+
+	//Circle-circle pairs are deferred to the batch, everything else goes through the generic dispatch
+	for (size_t iCheck = 0; iCheck < count; ++iCheck) {
+		auto& cTargetPair = listCheck->at(iCheck);
+
+		StgIntersectionTarget* targetA = cTargetPair.first;
+		StgIntersectionTarget* targetB = cTargetPair.second;
+		if (targetA == nullptr || targetB == nullptr) {
+			listCheckResult_[iCheck] = false;
+			continue;
+		}
+
+		if (targetA->GetShape() == StgIntersectionTarget::SHAPE_CIRCLE 
+			&& targetB->GetShape() == StgIntersectionTarget::SHAPE_CIRCLE) 
+		{
+			batchCircle_.AddPair(iCheck, 
+				((StgIntersectionTarget_Circle*)targetA)->GetCircle(),
+				((StgIntersectionTarget_Circle*)targetB)->GetCircle());
+		}
+		else
+			listCheckResult_[iCheck] = IsIntersected(targetA, targetB);
+	}
+
+	batchCircle_.Test(listCheckResult_);
+}
+
+void StgIntersectionManager::AddVisualization(StgIntersectionTarget* target) {
 	if (!bRenderIntersection_ || target == nullptr) return;
 
 	ParticleRenderer2D* objParticleCircle = objIntersectionVisualizerCircle_->GetParticlePointer();
@@ -334,7 +390,7 @@ void StgIntersectionManager::AddVisualization(ref_unsync_ptr<StgIntersectionTarg
 	switch (target->GetTargetType()) {
 	case StgIntersectionTarget::TYPE_PLAYER:
 	{
-		if (dynamic_cast<StgIntersectionTarget_Player*>(target.get())->IsGraze())
+		if (dynamic_cast<StgIntersectionTarget_Player*>(target)->IsGraze())
 			color = D3DCOLOR_ARGB(192, 48, 212, 48);
 		else
 			color = D3DCOLOR_XRGB(0, 255, 0);
@@ -357,7 +413,7 @@ void StgIntersectionManager::AddVisualization(ref_unsync_ptr<StgIntersectionTarg
 	switch (target->GetShape()) {
 	case StgIntersectionTarget::SHAPE_CIRCLE:
 	{
-		StgIntersectionTarget_Circle* pTarget = dynamic_cast<StgIntersectionTarget_Circle*>(target.get());
+		StgIntersectionTarget_Circle* pTarget = dynamic_cast<StgIntersectionTarget_Circle*>(target);
 		DxCircle& circle = pTarget->GetCircle();
 
 		objParticleCircle->SetInstancePosition(circle.GetX(), circle.GetY(), 0.0f);
@@ -373,7 +429,7 @@ void StgIntersectionManager::AddVisualization(ref_unsync_ptr<StgIntersectionTarg
 	{
 		if (countLineVertex_ >= (65536U / 6U) * 6U) break;
 
-		StgIntersectionTarget_Line* pTarget = dynamic_cast<StgIntersectionTarget_Line*>(target.get());
+		StgIntersectionTarget_Line* pTarget = dynamic_cast<StgIntersectionTarget_Line*>(target);
 		DxWidthLine& line = pTarget->GetLine();
 
 		DxLine splitLines[2];
@@ -438,21 +494,118 @@ ref_unsync_ptr<StgIntersectionTarget> StgIntersectionCheckList::GetTargetB(size_
 	return target;
 }
 
+//*******************************************************************
+//StgIntersectionCircleBatch
+//*******************************************************************
+StgIntersectionCircleBatch::StgIntersectionCircleBatch() {
+	count_ = 0;
+}
+void StgIntersectionCircleBatch::AddPair(size_t index, const DxCircle& circle1, const DxCircle& circle2) {
+	if (listIndex_.size() <= count_) {
+		//Always a multiple of 4 so the last batch can be loaded whole
+		size_t size = std::max<size_t>(listIndex_.size() * 2U, 64U);
+		listX1_.resize(size);
+		listY1_.resize(size);
+		listR1_.resize(size);
+		listX2_.resize(size);
+		listY2_.resize(size);
+		listR2_.resize(size);
+		listIndex_.resize(size);
+	}
+	listX1_[count_] = circle1.GetX();
+	listY1_[count_] = circle1.GetY();
+	listR1_[count_] = circle1.GetR();
+	listX2_[count_] = circle2.GetX();
+	listY2_[count_] = circle2.GetY();
+	listR2_[count_] = circle2.GetR();
+	listIndex_[count_] = index;
+	++count_;
+}
+void StgIntersectionCircleBatch::Test(std::vector<uint8_t>& listResult) {
+	//Same operations as DxIntersect::Circle_Circle, without fused multiply-add so the results match exactly
+	for (size_t i = 0; i < count_; i += 4U) {
+		__m128 dx = Vectorize::Sub(Vectorize::Load(&listX1_[i]), Vectorize::Load(&listX2_[i]));
+		__m128 dy = Vectorize::Sub(Vectorize::Load(&listY1_[i]), Vectorize::Load(&listY2_[i]));
+		__m128 rr = Vectorize::Add(Vectorize::Load(&listR1_[i]), Vectorize::Load(&listR2_[i]));
+		__m128 dd = Vectorize::Add(Vectorize::Mul(dx, dx), Vectorize::Mul(dy, dy));
+		int mask = Vectorize::CompareLE(dd, Vectorize::Mul(rr, rr));
+
+		size_t countLane = std::min<size_t>(count_ - i, 4U);
+		for (size_t iLane = 0; iLane < countLane; ++iLane)
+			listResult[listIndex_[i + iLane]] = (mask >> iLane) & 1;
+	}
+}
+
+//*******************************************************************
+//StgIntersectionGrid
+//*******************************************************************
+StgIntersectionGrid::StgIntersectionGrid() {
+	countX_ = 1;
+	countY_ = 1;
+	pListSource_ = nullptr;
+}
+void StgIntersectionGrid::Initialize(const DxRect<LONG>& rect) {
+	rect_ = rect;
+	countX_ = std::max<LONG>((rect.GetWidth() + CELL_SIZE - 1) / CELL_SIZE, 1);
+	countY_ = std::max<LONG>((rect.GetHeight() + CELL_SIZE - 1) / CELL_SIZE, 1);
+	listCellStart_.resize(countX_ * countY_ + 1U);
+}
+bool StgIntersectionGrid::_GetCellRange(const DxRect<LONG>& rect, DxRect<LONG>& range) const {
+	if (rect.left > rect.right || rect.top > rect.bottom) return false;
+	range.left = _GetCell(rect.left, rect_.left, countX_);
+	range.top = _GetCell(rect.top, rect_.top, countY_);
+	range.right = _GetCell(rect.right, rect_.left, countX_);
+	range.bottom = _GetCell(rect.bottom, rect_.top, countY_);
+	return (size_t)(range.GetWidth() + 1) * (size_t)(range.GetHeight() + 1) <= MAX_CELL_AREA;
+}
+void StgIntersectionGrid::Build(std::vector<StgIntersectionTarget*>* pList) {
+	pListSource_ = pList;
+	listLargeTarget_.clear();
+	std::fill(listCellStart_.begin(), listCellStart_.end(), 0U);
+
+	//Counting sort into the cells, targets keep their list order within each cell
+	DxRect<LONG> range;
+	for (StgIntersectionTarget* target : *pList) {
+		if (!_GetCellRange(target->GetIntersectionSpaceRect(), range)) continue;
+		for (LONG iy = range.top; iy <= range.bottom; ++iy) {
+			for (LONG ix = range.left; ix <= range.right; ++ix)
+				++listCellStart_[iy * countX_ + ix + 1];
+		}
+	}
+	for (size_t iCell = 1; iCell < listCellStart_.size(); ++iCell)
+		listCellStart_[iCell] += listCellStart_[iCell - 1];
+	listCellTarget_.resize(listCellStart_.back());
+
+	std::vector<uint32_t> listCellFill(listCellStart_.begin(), listCellStart_.end() - 1);
+	for (StgIntersectionTarget* target : *pList) {
+		if (!_GetCellRange(target->GetIntersectionSpaceRect(), range)) {
+			listLargeTarget_.push_back(target);
+			continue;
+		}
+		for (LONG iy = range.top; iy <= range.bottom; ++iy) {
+			for (LONG ix = range.left; ix <= range.right; ++ix)
+				listCellTarget_[listCellFill[iy * countX_ + ix]++] = target;
+		}
+	}
+}
+
 //*******************************************************************
 //StgIntersectionSpace
 //*******************************************************************
 StgIntersectionSpace::StgIntersectionSpace() {
 	spaceRect_ = DxRect<double>(0, 0, 0, 0);
 	previousCheckCreated_ = 0;
+	countRectTest_ = 0;
 }
 StgIntersectionSpace::~StgIntersectionSpace() {
 }
 bool StgIntersectionSpace::Initialize(double left, double top, double right, double bottom) {
 	spaceRect_ = DxRect<double>(left, top, right, bottom);
 	pooledCheckList_.resize(64U);
+	grid_.Initialize(DxRect<LONG>(left, top, right, bottom));
 	return true;
 }
-bool StgIntersectionSpace::RegistTarget(ListTarget* pVec, ref_unsync_ptr<StgIntersectionTarget>& target) {
+bool StgIntersectionSpace::RegistTarget(ListTarget* pVec, StgIntersectionTarget* target) {
 	if (!spaceRect_.IsIntersected(target->GetIntersectionSpaceRect()))
 		return false;
 	pVec->push_back(target);
@@ -474,8 +627,8 @@ std::vector<StgIntersectionSpace::TargetCheckListPair>* StgIntersectionSpace::Cr
 	ListTarget* pListTargetA = &pairTargetList_.first;
 	ListTarget* pListTargetB = &pairTargetList_.second;
 
-	CriticalSection& criticalSection = manager->GetLock();
-	std::atomic_uint count = 0;
+	size_t count = 0;
+	std::atomic<size_t> countTest = 0;
 
 	if (manager->IsEnableVisualizer()) {
 		/*
@@ -493,53 +646,73 @@ std::vector<StgIntersectionSpace::TargetCheckListPair>* StgIntersectionSpace::Cr
 	}
 
 	if (pListTargetA->size() > 0 && pListTargetB->size() > 0) {
-		auto CheckSpaceRect = [&](StgIntersectionTarget* targetA, StgIntersectionTarget* targetB) {
-			if (targetA == nullptr || targetB == nullptr) return;
-			const DxRect<LONG>& boundA = targetA->GetIntersectionSpaceRect();
-			const DxRect<LONG>& boundB = targetB->GetIntersectionSpaceRect();
-			if (boundA.IsIntersected(boundB)) {
-				Lock lock(criticalSection);
-				if ((size_t)count >= pooledCheckList_.size()) {
-					pooledCheckList_.resize(pooledCheckList_.size() * 2);
-				}
-				pooledCheckList_[count.load()] = std::make_pair(targetA, targetB);
-				++count;
-			}
-		};
-
 		//Attempt to most efficiently utilize multithreading
-		if (pListTargetA->size() >= pListTargetB->size()) {
-			ParallelFor(pListTargetA->size(), [&](size_t iA) {
-				StgIntersectionTarget* pTargetA = pListTargetA->at(iA).get();
-				for (auto itrB = pListTargetB->begin(); itrB != pListTargetB->end(); ++itrB) {
-					StgIntersectionTarget* pTargetB = itrB->get();
-					CheckSpaceRect(pTargetA, pTargetB);
+		//	The larger list is iterated in parallel, the smaller one is bucketed into the grid
+		bool bIterateA = pListTargetA->size() >= pListTargetB->size();
+		ListTarget* pListIterate = bIterateA ? pListTargetA : pListTargetB;
+		ListTarget* pListGrid = bIterateA ? pListTargetB : pListTargetA;
+
+		bool bUseGrid = pListGrid->size() >= StgIntersectionGrid::MIN_TARGET;
+		if (bUseGrid)
+			grid_.Build(pListGrid);
+
+		//Each chunk of the iterated list writes into its own buffer, the buffers are then
+		//	concatenated in chunk order so the pairs always come out in the same sequence
+		size_t countIterate = pListIterate->size();
+		size_t countChunk = std::min<size_t>(countIterate, 
+			std::max(std::thread::hardware_concurrency(), 1U) * 4U);
+		if (listChunkCheck_.size() < countChunk)
+			listChunkCheck_.resize(countChunk);
+
+		ParallelFor(countChunk, [&](size_t iChunk) {
+			std::vector<TargetCheckListPair>& listCheck = listChunkCheck_[iChunk];
+			listCheck.clear();
+
+			auto AddCheckPair = [&](StgIntersectionTarget* pTarget, StgIntersectionTarget* pOther) {
+				if (bIterateA) listCheck.push_back(std::make_pair(pTarget, pOther));
+				else listCheck.push_back(std::make_pair(pOther, pTarget));
+			};
+
+			size_t countChunkTest = 0;
+			const size_t begin = countIterate * iChunk / countChunk;
+			const size_t end = countIterate * (iChunk + 1U) / countChunk;
+			for (size_t i = begin; i < end; ++i) {
+				StgIntersectionTarget* pTarget = pListIterate->at(i);
+				if (pTarget == nullptr) continue;
+
+				if (bUseGrid) {
+					countChunkTest += grid_.Query(pTarget, [&](StgIntersectionTarget* pOther) {
+						AddCheckPair(pTarget, pOther);
+					});
 				}
-			});
-		}
-		else {
-			ParallelFor(pListTargetB->size(), [&](size_t iB) {
-				StgIntersectionTarget* pTargetB = pListTargetB->at(iB).get();
-				for (auto itrA = pListTargetA->begin(); itrA != pListTargetA->end(); ++itrA) {
-					StgIntersectionTarget* pTargetA = itrA->get();
-					CheckSpaceRect(pTargetA, pTargetB);
+				else {
+					const DxRect<LONG>& bound = pTarget->GetIntersectionSpaceRect();
+					for (StgIntersectionTarget* pOther : *pListGrid) {
+						if (bound.IsIntersected(pOther->GetIntersectionSpaceRect()))
+							AddCheckPair(pTarget, pOther);
+					}
+					countChunkTest += pListGrid->size();
 				}
-			});
-		}
-		/*
-		//No multithreading mode
-		for (auto itrA = pListTargetA->begin(); itrA != pListTargetA->end(); ++itrA) {
-			StgIntersectionTarget* pTargetA = itrA->get();
-			for (auto itrB = pListTargetB->begin(); itrB != pListTargetB->end(); ++itrB) {
-				StgIntersectionTarget* pTargetB = itrB->get();
-				CheckSpaceRect(pTargetA, pTargetB);
 			}
+			countTest += countChunkTest;
+		});
+
+		for (size_t iChunk = 0; iChunk < countChunk; ++iChunk)
+			count += listChunkCheck_[iChunk].size();
+		if (count > pooledCheckList_.size())
+			pooledCheckList_.resize(std::max(count, pooledCheckList_.size() * 2));
+
+		auto itrDst = pooledCheckList_.begin();
+		for (size_t iChunk = 0; iChunk < countChunk; ++iChunk) {
+			std::vector<TargetCheckListPair>& listCheck = listChunkCheck_[iChunk];
+			itrDst = std::copy(listCheck.begin(), listCheck.end(), itrDst);
+			listCheck.clear();
 		}
-		*/
 	}
 
-	total = (size_t)count;
+	total = count;
 	previousCheckCreated_ = total;
+	countRectTest_ = countTest;
 	return &pooledCheckList_;
 }
 
@@ -674,4 +847,13 @@ std::wstring StgIntersectionTarget::GetInfoAsString() {
 	res += L"] ";
 
 	return res;
-}
\ No newline at end of file
+}
+//*******************************************************************
+//StgIntersectionTarget_Circle
+//*******************************************************************
+void* StgIntersectionTarget_Circle::operator new(size_t size) {
+	return StgShotManager::AllocatePooled(StgShotManager::POOL_TARGET_CIRCLE, size);
+}
+void StgIntersectionTarget_Circle::operator delete(void* ptr, size_t size) {
+	StgShotManager::ReleasePooled(StgShotManager::POOL_TARGET_CIRCLE, ptr, size);
+}
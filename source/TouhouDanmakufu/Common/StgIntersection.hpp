@@ -6,6 +6,7 @@
 
 class StgIntersectionManager;
 class StgIntersectionSpace;
+class StgIntersectionGrid;
 class StgIntersectionCheckList;
 
 class StgIntersectionObject;
@@ -66,6 +67,9 @@ public:
 	StgIntersectionTarget_Circle() { shape_ = Shape::SHAPE_CIRCLE; }
 	virtual ~StgIntersectionTarget_Circle() {}
 
+	static void* operator new(size_t size);
+	static void operator delete(void* ptr, size_t size);
+
 	virtual void SetIntersectionSpace() {
 		StgIntersectionTarget::SetIntersectionSpace(circle_.GetBounds());
 	}
@@ -95,6 +99,30 @@ public:
 	}
 };
 
+//*******************************************************************
+//StgIntersectionCircleBatch
+//	Circle-circle narrowphase, pairs are stored as structure-of-arrays and tested 4 at a time
+//*******************************************************************
+class StgIntersectionCircleBatch {
+	std::vector<float> listX1_;
+	std::vector<float> listY1_;
+	std::vector<float> listR1_;
+	std::vector<float> listX2_;
+	std::vector<float> listY2_;
+	std::vector<float> listR2_;
+	std::vector<uint32_t> listIndex_;
+	size_t count_;
+public:
+	StgIntersectionCircleBatch();
+
+	void Clear() { count_ = 0; }
+	size_t GetCount() const { return count_; }
+
+	void AddPair(size_t index, const DxCircle& circle1, const DxCircle& circle2);
+	//Writes the result of each pair into listResult at the index it was added with
+	void Test(std::vector<uint8_t>& listResult);
+};
+
 class StgIntersectionTargetPoint;
 
 //*******************************************************************
@@ -122,7 +150,15 @@ private:
 	shared_ptr<Shader> shaderVisualizerCircle_;
 	shared_ptr<Shader> shaderVisualizerLine_;
 
+	//Targets registered through ref_unsync_ptr, kept alive until the end of the frame
+	std::vector<ref_unsync_ptr<StgIntersectionTarget>> listTargetHold_;
+
+	StgIntersectionCircleBatch batchCircle_;
+	std::vector<uint8_t> listCheckResult_;
+
 	CriticalSection lock_;
+
+	void _TestCheckList(std::vector<std::pair<StgIntersectionTarget*, StgIntersectionTarget*>>* listCheck, size_t count);
 public:
 	StgIntersectionManager();
 	virtual ~StgIntersectionManager();
@@ -136,6 +172,8 @@ public:
 	int GetVisualizerRenderPriority() { return visualizerRenderPri_; }
 
 	void AddTarget(ref_unsync_ptr<StgIntersectionTarget> target);
+	//The caller must keep target alive until Work() has finished, no reference is taken
+	void AddTarget(StgIntersectionTarget* target, bool bEraseShot);
 	void AddEnemyTargetToShot(ref_unsync_ptr<StgIntersectionTarget> target);
 	void AddEnemyTargetToPlayer(ref_unsync_ptr<StgIntersectionTarget> target);
 	std::vector<StgIntersectionTargetPoint>* GetAllEnemyTargetPoint() { return &listEnemyTargetPoint_; }
@@ -144,7 +182,7 @@ public:
 
 	CriticalSection& GetLock() { return lock_; }
 
-	void AddVisualization(ref_unsync_ptr<StgIntersectionTarget>& target);
+	void AddVisualization(StgIntersectionTarget* target);
 };
 
 class StgIntersectionCheckList {
@@ -164,13 +202,54 @@ public:
 	ref_unsync_ptr<StgIntersectionTarget> GetTargetB(size_t index);
 };
 
+//*******************************************************************
+//StgIntersectionGrid
+//	Uniform grid broadphase, buckets targets by their intersection space rects
+//*******************************************************************
+class StgIntersectionGrid {
+public:
+	enum : LONG {
+		CELL_SIZE = 32,
+	};
+	enum : size_t {
+		MAX_CELL_AREA = 64,		//Targets covering more cells than this are checked against everything
+		MIN_TARGET = 8,			//Below this, the brute force check is cheaper than building the grid
+	};
+private:
+	DxRect<LONG> rect_;
+	LONG countX_;
+	LONG countY_;
+
+	std::vector<StgIntersectionTarget*>* pListSource_;
+	std::vector<uint32_t> listCellStart_;
+	std::vector<StgIntersectionTarget*> listCellTarget_;
+	std::vector<StgIntersectionTarget*> listLargeTarget_;
+
+	inline LONG _GetCell(LONG pos, LONG origin, LONG count) const {
+		int64_t res = ((int64_t)pos - (int64_t)origin) / CELL_SIZE;
+		return (LONG)std::clamp<int64_t>(res, 0, count - 1);
+	}
+	bool _GetCellRange(const DxRect<LONG>& rect, DxRect<LONG>& range) const;
+public:
+	StgIntersectionGrid();
+
+	void Initialize(const DxRect<LONG>& rect);
+	void Build(std::vector<StgIntersectionTarget*>* pList);
+
+	//Calls func(other) once for every built target whose space rect intersects target's
+	//	Returns the amount of rect tests performed
+	template<class F> size_t Query(StgIntersectionTarget* target, F&& func) const;
+
+	size_t GetCellCount() const { return countX_ * countY_; }
+};
+
 class StgIntersectionSpace {
 	enum {
 		TYPE_A = 0,
 		TYPE_B = 1,
 	};
 public:
-	typedef std::vector<ref_unsync_ptr<StgIntersectionTarget>> ListTarget;
+	typedef std::vector<StgIntersectionTarget*> ListTarget;
 	typedef std::pair<StgIntersectionTarget*, StgIntersectionTarget*> TargetCheckListPair;
 protected:
 	DxRect<double> spaceRect_;
@@ -178,20 +257,70 @@ protected:
 	size_t previousCheckCreated_;
 	std::pair<ListTarget, ListTarget> pairTargetList_;
 	std::vector<TargetCheckListPair> pooledCheckList_;
+	std::vector<std::vector<TargetCheckListPair>> listChunkCheck_;
+
+	StgIntersectionGrid grid_;
+	size_t countRectTest_;
 public:
 	StgIntersectionSpace();
 	virtual ~StgIntersectionSpace();
 
 	bool Initialize(double left, double top, double right, double bottom);
 
-	bool RegistTarget(ListTarget* pVec, ref_unsync_ptr<StgIntersectionTarget>& target);
-	bool RegistTargetA(ref_unsync_ptr<StgIntersectionTarget>& target) { return RegistTarget(&pairTargetList_.first, target); }
-	bool RegistTargetB(ref_unsync_ptr<StgIntersectionTarget>& target) { return RegistTarget(&pairTargetList_.second, target); }
+	bool RegistTarget(ListTarget* pVec, StgIntersectionTarget* target);
+	bool RegistTargetA(StgIntersectionTarget* target) { return RegistTarget(&pairTargetList_.first, target); }
+	bool RegistTargetB(StgIntersectionTarget* target) { return RegistTarget(&pairTargetList_.second, target); }
 	void ClearTarget();
 
 	std::vector<TargetCheckListPair>* CreateIntersectionCheckList(StgIntersectionManager* manager, size_t& total);
+
+	size_t GetTargetCount() const { return pairTargetList_.first.size() + pairTargetList_.second.size(); }
+	size_t GetRectTestCount() const { return countRectTest_; }
 };
 
+template<class F> size_t StgIntersectionGrid::Query(StgIntersectionTarget* target, F&& func) const {
+	const DxRect<LONG>& rect = target->GetIntersectionSpaceRect();
+	size_t countTest = 0;
+
+	DxRect<LONG> range;
+	if (!_GetCellRange(rect, range)) {
+		//Degenerate or oversized, fall back to checking against everything
+		for (StgIntersectionTarget* other : *pListSource_) {
+			++countTest;
+			if (rect.IsIntersected(other->GetIntersectionSpaceRect()))
+				func(other);
+		}
+		return countTest;
+	}
+
+	for (LONG iy = range.top; iy <= range.bottom; ++iy) {
+		for (LONG ix = range.left; ix <= range.right; ++ix) {
+			size_t iCell = iy * countX_ + ix;
+			for (uint32_t i = listCellStart_[iCell]; i < listCellStart_[iCell + 1]; ++i) {
+				StgIntersectionTarget* other = listCellTarget_[i];
+				const DxRect<LONG>& rectOther = other->GetIntersectionSpaceRect();
+
+				++countTest;
+				if (!rect.IsIntersected(rectOther)) continue;
+
+				//A pair sharing multiple cells is only reported from the cell containing
+				//	the top-left corner of the overlap
+				LONG cx = _GetCell(std::max(rect.left, rectOther.left), rect_.left, countX_);
+				LONG cy = _GetCell(std::max(rect.top, rectOther.top), rect_.top, countY_);
+				if (cx == ix && cy == iy)
+					func(other);
+			}
+		}
+	}
+	for (StgIntersectionTarget* other : listLargeTarget_) {
+		++countTest;
+		if (rect.IsIntersected(other->GetIntersectionSpaceRect()))
+			func(other);
+	}
+
+	return countTest;
+}
+
 class StgIntersectionObject {
 public:
 	using IntersectionPairType = std::pair<bool, ref_unsync_ptr<StgIntersectionTarget>>;
@@ -6,16 +6,61 @@
 #include "StgItem.hpp"
 #include "../../GcLib/directx/HLSL.hpp"
 
+//****************************************************************************
+//StgShotCoreStore
+//****************************************************************************
+void StgShotCoreStore::Add(ref_unsync_ptr<StgShotObject> obj) {
+	listObject.push_back(obj);
+	listFlag.push_back(0);
+	Sync(listObject.size() - 1U);
+}
+void StgShotCoreStore::Sync(size_t index) {
+	StgShotObject* obj = listObject[index].get();
+
+	uint8_t flag = 0;
+	if (obj->IsActive()) flag |= FLAG_ACTIVE;
+	if (obj->IsDeleted()) flag |= FLAG_DELETED;
+	if (obj->GetOwnerType() == StgShotObject::OWNER_PLAYER) flag |= FLAG_OWNER_PLAYER;
+
+	//Lasers decide for themselves
+	if (obj->GetObjectType() != TypeObject::Shot || obj->IsIntersectionActive())
+		flag |= FLAG_INTERSECTION;
+
+	listFlag[index] = flag;
+}
+template<class F> void StgShotCoreStore::RemoveIf(F&& pred) {
+	size_t iDst = 0;
+	for (size_t iSrc = 0; iSrc < listObject.size(); ++iSrc) {
+		if (pred(iSrc)) continue;
+		if (iDst != iSrc) {
+			listObject[iDst] = listObject[iSrc];
+			listFlag[iDst] = listFlag[iSrc];
+		}
+		++iDst;
+	}
+	listObject.resize(iDst);
+	listFlag.resize(iDst);
+}
+
 //****************************************************************************
 //StgShotManager
 //****************************************************************************
-StgShotManager::StgShotManager(StgStageController* stageController) {
+StgShotManager* StgShotManager::active_ = nullptr;
+
+StgShotManager::StgShotManager(StgStageController* stageController) :
+	poolShot_(sizeof(StgNormalShotObject)),
+	poolPatternAngle_(sizeof(StgMovePattern_Angle)),
+	poolPatternXY_(sizeof(StgMovePattern_XY)),
+	poolTargetCircle_(sizeof(StgIntersectionTarget_Circle))
+{
+	active_ = this;
 	stageController_ = stageController;
 
 	listPlayerShotData_ = std::make_unique<StgShotDataList>();
 	listEnemyShotData_ = std::make_unique<StgShotDataList>();
 
 	rcDeleteClip_ = DxRect<LONG>(-64, -64, 64, 64);
+	bParallelWork_ = false;
 
 	filterMin_ = D3DTEXF_LINEAR;
 	filterMag_ = D3DTEXF_LINEAR;
@@ -41,23 +86,101 @@ StgShotManager::StgShotManager(StgStageController* stageController) {
 	SetDeleteEventEnableByType(StgStageItemScript::EV_DELETE_SHOT_TO_ITEM, true);
 }
 StgShotManager::~StgShotManager() {
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	//Objects freed from here on go straight back to the heap
+	if (active_ == this)
+		active_ = nullptr;
+
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj)
 			obj->ClearShotObject();
 	}
 }
+
+void* StgShotManager::AllocatePooled(int type, size_t size) {
+	if (active_ == nullptr)
+		return ::operator new(size);
+	return active_->GetPool(type)->Allocate(size);
+}
+void StgShotManager::ReleasePooled(int type, void* ptr, size_t size) {
+	if (active_ == nullptr) {
+		::operator delete(ptr);
+		return;
+	}
+	active_->GetPool(type)->Release(ptr, size);
+}
+StgObjectPool* StgShotManager::GetPool(int type) {
+	switch (type) {
+	case POOL_SHOT:
+		return &poolShot_;
+	case POOL_PATTERN_ANGLE:
+		return &poolPatternAngle_;
+	case POOL_PATTERN_XY:
+		return &poolPatternXY_;
+	case POOL_TARGET_CIRCLE:
+		return &poolTargetCircle_;
+	}
+	return nullptr;
+}
+
+void StgShotManager::TakeSpareIntersectionList(StgIntersectionObject::IntersectionListType& list) {
+	if (listSpareIntersection_.empty()) return;
+	list.swap(listSpareIntersection_.back());
+	listSpareIntersection_.pop_back();
+}
+void StgShotManager::ReturnSpareIntersectionList(StgIntersectionObject::IntersectionListType& list) {
+	if (list.empty() || listSpareIntersection_.size() >= SHOT_MAX) return;
+
+	//Targets are rewritten before each use, but ones a clone still shares stay with it
+	for (auto& iTarget : list) {
+		iTarget.first = false;
+		if (iTarget.second && (!iTarget.second.unique() || iTarget.second.weak_count() > 1))
+			iTarget.second = nullptr;
+	}
+	listSpareIntersection_.push_back(std::move(list));
+}
+unique_ptr<StgEnemyHitCooldownMap> StgShotManager::TakeSpareHitCooldownMap() {
+	if (listSpareHitCooldown_.empty())
+		return std::make_unique<StgEnemyHitCooldownMap>();
+	unique_ptr<StgEnemyHitCooldownMap> res = std::move(listSpareHitCooldown_.back());
+	listSpareHitCooldown_.pop_back();
+	return res;
+}
+void StgShotManager::ReturnSpareHitCooldownMap(unique_ptr<StgEnemyHitCooldownMap>& map) {
+	if (map == nullptr || listSpareHitCooldown_.size() >= SHOT_MAX) return;
+	map->clear();
+	listSpareHitCooldown_.push_back(std::move(map));
+}
+//Does the non-deleting part of Work for shots that only touch themselves, spread over the thread pool.
+//	Deletion, with its events and items, is left to each shot's own Work to keep the original order.
+//	Movement isn't, it happens before WorkObject, so this is opt-in and can change results.
+void StgShotManager::WorkParallel() {
+	if (!bParallelWork_) return;
+
+	listParallelWork_.clear();
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
+		if (obj->GetObjectType() != TypeObject::Shot) continue;
+
+		StgNormalShotObject* shot = (StgNormalShotObject*)obj.get();
+		if (shot->ReserveWorkAhead())
+			listParallelWork_.push_back(shot);
+	}
+
+	ParallelFor(listParallelWork_.size(), [&](size_t i) {
+		listParallelWork_[i]->WorkAhead();
+	}, 64);
+}
 void StgShotManager::Work() {
-	for (auto itr = listObj_.begin(); itr != listObj_.end(); ) {
-		ref_unsync_ptr<StgShotObject>& obj = *itr;
-		if (obj->IsDeleted()) {
-			obj->ClearShotObject();
-			itr = listObj_.erase(itr);
-		}
-		else if (!obj->IsActive()) {
-			itr = listObj_.erase(itr);
+	for (size_t i = 0; i < store_.GetSize(); ++i)
+		store_.Sync(i);
+
+	store_.RemoveIf([&](size_t i) {
+		uint8_t flag = store_.listFlag[i];
+		if (flag & StgShotCoreStore::FLAG_DELETED) {
+			store_.listObject[i]->ClearShotObject();
+			return true;
 		}
-		else ++itr;
-	}
+		return (flag & StgShotCoreStore::FLAG_ACTIVE) == 0;
+	});
 }
 
 std::array<BlendMode, StgShotManager::BLEND_COUNT> StgShotManager::blendTypeRenderOrder = {
@@ -139,29 +262,39 @@ void StgShotManager::LoadRenderQueue() {
 		listRenderQueueEnemy_[i].count = 0;
 	}
 
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
-		if (obj->IsDeleted() || !obj->IsActive() || !obj->IsVisible()) continue;
+	for (size_t i = 0; i < store_.GetSize(); ++i) {
+		uint8_t flag = store_.listFlag[i];
+		if ((flag & (StgShotCoreStore::FLAG_ACTIVE | StgShotCoreStore::FLAG_DELETED)) != StgShotCoreStore::FLAG_ACTIVE)
+			continue;
+
+		//Deletion, visibility and render priority can all change after the sync, so they're read live
+		StgShotObject* obj = store_.listObject[i].get();
+		if (obj->IsDeleted() || !obj->IsVisible()) continue;
 
-		auto& [count, listShot] = (obj->GetOwnerType() == StgShotObject::OWNER_PLAYER ?
+		auto& [count, listShot] = ((flag & StgShotCoreStore::FLAG_OWNER_PLAYER) ?
 			listRenderQueuePlayer_ : listRenderQueueEnemy_)[obj->GetRenderPriorityI()];
 
 		while (count >= listShot.size())
 			listShot.resize(listShot.size() * 2);
-		listShot[count++] = obj.get();
+		listShot[count++] = obj;
 	}
 }
 
 void StgShotManager::RegistIntersectionTarget() {
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
-		if (!obj->IsDeleted() && obj->IsActive()) {
-			obj->ClearIntersectedIdList();
+	for (size_t i = 0; i < store_.GetSize(); ++i) {
+		uint8_t flag = store_.listFlag[i];
+		if ((flag & (StgShotCoreStore::FLAG_ACTIVE | StgShotCoreStore::FLAG_DELETED)) != StgShotCoreStore::FLAG_ACTIVE) 
+			continue;
+
+		StgShotObject* obj = store_.listObject[i].get();
+		obj->ClearIntersectedIdList();
+		if (flag & StgShotCoreStore::FLAG_INTERSECTION)
 			obj->RegistIntersectionTarget();
-		}
 	}
 }
 void StgShotManager::AddShot(ref_unsync_ptr<StgShotObject> obj) {
 	obj->SetOwnObjectReference();
-	listObj_.push_back(obj);
+	store_.Add(obj);
 }
 
 size_t StgShotManager::DeleteInCircle(int typeDelete, int typeTo, int typeOwner, int cx, int cy, int* radius) {
@@ -172,7 +305,7 @@ size_t StgShotManager::DeleteInCircle(int typeDelete, int typeTo, int typeOwner,
 
 	size_t res = 0;
 
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj->IsDeleted()) continue;
 		if ((typeOwner != StgShotObject::OWNER_NULL) && (obj->GetOwnerType() != typeOwner)) continue;
 		if (typeDelete == DEL_TYPE_SHOT && obj->IsSpellResist()) continue;
@@ -209,7 +342,7 @@ size_t StgShotManager::DeleteInRegularPolygon(int typeDelete, int typeTo, int ty
 
 	size_t res = 0;
 
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj->IsDeleted()) continue;
 		if ((typeOwner != StgShotObject::OWNER_NULL) && (obj->GetOwnerType() != typeOwner)) continue;
 		if (typeDelete == DEL_TYPE_SHOT && obj->IsSpellResist()) continue;
@@ -262,7 +395,7 @@ std::vector<int> StgShotManager::GetShotIdInCircle(int typeOwner, int cx, int cy
 	DxRect<int> rcBox(cx - r, cy - r, cx + r, cy + r);
 
 	std::vector<int> res;
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj->IsDeleted()) continue;
 		if ((typeOwner != StgShotObject::OWNER_NULL) && (obj->GetOwnerType() != typeOwner)) continue;
 
@@ -286,7 +419,7 @@ std::vector<int> StgShotManager::GetShotIdInRegularPolygon(int typeOwner, int cx
 	int rect_y2 = cy + r;
 
 	std::vector<int> res;
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj->IsDeleted()) continue;
 		if ((typeOwner != StgShotObject::OWNER_NULL) && (obj->GetOwnerType() != typeOwner)) continue;
 
@@ -319,7 +452,7 @@ std::vector<int> StgShotManager::GetShotIdInRegularPolygon(int typeOwner, int cx
 }
 std::vector<int> StgShotManager::GetLaserIdAll(int typeOwner) {
 	std::vector<int> res;
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj->IsDeleted()) continue;
 		if ((typeOwner != StgShotObject::OWNER_NULL) && (obj->GetOwnerType() != typeOwner)) continue;
 		if (obj->GetObjectType() == TypeObject::Shot) continue;
@@ -332,7 +465,7 @@ std::vector<int> StgShotManager::GetLaserIdAll(int typeOwner) {
 size_t StgShotManager::GetShotCount(int typeOwner) {
 	size_t res = 0;
 
-	for (ref_unsync_ptr<StgShotObject>& obj : listObj_) {
+	for (ref_unsync_ptr<StgShotObject>& obj : store_.listObject) {
 		if (obj->IsDeleted()) continue;
 		if ((typeOwner != StgShotObject::OWNER_NULL) && (obj->GetOwnerType() != typeOwner)) continue;
 		++res;
@@ -891,6 +1024,8 @@ StgShotObject::StgShotObject(StgStageController* stageController) : StgMoveObjec
 	bRoundingPosition_ = false;
 	roundingAngle_ = 0;
 
+	bWorkAhead_ = false;
+
 	hitboxScale_ = D3DXVECTOR2(1.0f, 1.0f);
 
 	timerTransform_ = 0;
@@ -900,6 +1035,8 @@ StgShotObject::StgShotObject(StgStageController* stageController) : StgMoveObjec
 	SetRenderPriorityI(priShotI);
 }
 StgShotObject::~StgShotObject() {
+	if (StgShotManager* shotManager = StgShotManager::GetActive())
+		shotManager->ReturnSpareHitCooldownMap(mapEnemyHitCooldown_);
 }
 
 void StgShotObject::Clone(DxScriptObjectBase* _src) {
@@ -927,7 +1064,10 @@ void StgShotObject::Clone(DxScriptObjectBase* _src) {
 	renderTarget_ = src->renderTarget_;
 
 	frameEnemyHitInvalid_ = src->frameEnemyHitInvalid_;
-	mapEnemyHitCooldown_ = src->mapEnemyHitCooldown_;
+	if (src->mapEnemyHitCooldown_ && !src->mapEnemyHitCooldown_->empty())
+		*_GetEnemyHitCooldownMap() = *src->mapEnemyHitCooldown_;
+	else if (mapEnemyHitCooldown_)
+		mapEnemyHitCooldown_->clear();
 
 	bRequestedPlayerDeleteEvent_ = src->bRequestedPlayerDeleteEvent_;
 	damage_ = src->damage_;
@@ -1040,32 +1180,52 @@ void StgShotObject::_DeleteInAutoDeleteFrame() {
 	else --frameAutoDelete_;
 }
 void StgShotObject::_CommonWorkTask() {
+	_CommonWorkCounter();
+	_CommonWorkDelete();
+}
+void StgShotObject::_CommonWorkCounter() {
 	if (bEnableMovement_) {
 		++frameWork_;
 		if (frameFadeDelete_ >= 0) --frameFadeDelete_;
-		_DeleteInLife();
-		_DeleteInAutoClip();
-		_DeleteInAutoDeleteFrame();
-		_DeleteInFadeDelete();
 	}
 	--frameGrazeInvalid_;
 
 	//----------------------------------------------------------
 
-	for (auto itr = mapEnemyHitCooldown_.begin(); itr != mapEnemyHitCooldown_.end();) {
-		if (itr->first.expired() || itr->first->IsDeleted() || (--(itr->second) == 0))
-			itr = mapEnemyHitCooldown_.erase(itr);
-		else ++itr;
+	if (mapEnemyHitCooldown_) {
+		for (auto itr = mapEnemyHitCooldown_->begin(); itr != mapEnemyHitCooldown_->end();) {
+			if (itr->first.expired() || itr->first->IsDeleted() || (--(itr->second) == 0))
+				itr = mapEnemyHitCooldown_->erase(itr);
+			else ++itr;
+		}
 	}
 }
 
+void StgShotObject::_CommonWorkDelete() {
+	if (bEnableMovement_) {
+		_DeleteInLife();
+		_DeleteInAutoClip();
+		_DeleteInAutoDeleteFrame();
+		_DeleteInFadeDelete();
+	}
+}
+
+StgEnemyHitCooldownMap* StgShotObject::_GetEnemyHitCooldownMap() {
+	if (mapEnemyHitCooldown_ == nullptr) {
+		if (StgShotManager* shotManager = StgShotManager::GetActive())
+			mapEnemyHitCooldown_ = shotManager->TakeSpareHitCooldownMap();
+		else
+			mapEnemyHitCooldown_ = std::make_unique<StgEnemyHitCooldownMap>();
+	}
+	return mapEnemyHitCooldown_.get();
+}
 bool StgShotObject::CheckEnemyHitCooldownExists(ref_unsync_weak_ptr<StgEnemyObject> obj) {
-	if (mapEnemyHitCooldown_.empty()) return false;
-	return mapEnemyHitCooldown_.find(obj) != mapEnemyHitCooldown_.end();
+	if (mapEnemyHitCooldown_ == nullptr || mapEnemyHitCooldown_->empty()) return false;
+	return mapEnemyHitCooldown_->find(obj) != mapEnemyHitCooldown_->end();
 }
 void StgShotObject::AddEnemyHitCooldown(ref_unsync_weak_ptr<StgEnemyObject> obj, uint32_t time) {
 	if (obj) {
-		mapEnemyHitCooldown_[obj] = time;
+		(*_GetEnemyHitCooldownMap())[obj] = time;
 	}
 }
 
@@ -1174,6 +1334,11 @@ void StgShotObject::DeleteImmediate() {
 	objectManager->DeleteObject(this);
 }
 
+bool StgShotObject::_IsTransformActDue() {
+	if (listTransformationShotAct_.size() == 0) return false;
+	int timer = (timerTransform_ == 0) ? delay_.time : timerTransform_;
+	return timer == frameWork_;
+}
 void StgShotObject::_ProcessTransformAct() {
 	if (listTransformationShotAct_.size() == 0) return;
 
@@ -1525,8 +1690,14 @@ StgNormalShotObject::StgNormalShotObject(StgStageController* stageController) :
 
 	move_ = D3DXVECTOR2(1, 0);
 	lastAngle_ = 0;
+
+	//Laser targets aren't circles, so only normal shots trade their lists
+	if (StgShotManager* shotManager = StgShotManager::GetActive())
+		shotManager->TakeSpareIntersectionList(listIntersectionTarget_);
 }
 StgNormalShotObject::~StgNormalShotObject() {
+	if (StgShotManager* shotManager = StgShotManager::GetActive())
+		shotManager->ReturnSpareIntersectionList(listIntersectionTarget_);
 }
 
 void StgNormalShotObject::Clone(DxScriptObjectBase* _src) {
@@ -1539,6 +1710,21 @@ void StgNormalShotObject::Clone(DxScriptObjectBase* _src) {
 }
 
 void StgNormalShotObject::Work() {
+	if (bWorkAhead_) {
+		bWorkAhead_ = false;
+		_CommonWorkDelete();
+		return;
+	}
+
+	_WorkMotion();
+	_CommonWorkTask();
+}
+//Run from StgShotManager::WorkParallel, the rest is done in Work
+void StgNormalShotObject::WorkAhead() {
+	_WorkMotion();
+	_CommonWorkCounter();
+}
+void StgNormalShotObject::_WorkMotion() {
 	if (bEnableMovement_) {
 		_ProcessTransformAct();
 		_Move();
@@ -1563,16 +1749,12 @@ void StgNormalShotObject::Work() {
 			}
 		}
 	}
-
-	_CommonWorkTask();
 }
 
 void StgNormalShotObject::_AddIntersectionRelativeTarget() {
 	StgIntersectionManager* intersectionManager = stageController_->GetIntersectionManager();
 
-	if ((IsDeleted() || delay_.time > 0 || frameFadeDelete_ >= 0)
-		|| (bUserIntersectionMode_ || !bIntersectionEnable_)
-		|| pOwnReference_.expired())
+	if (IsDeleted() || !IsIntersectionActive() || pOwnReference_.expired())
 		return;
 
 	StgShotData* shotData = _GetShotData();
@@ -1582,16 +1764,15 @@ void StgNormalShotObject::_AddIntersectionRelativeTarget() {
 	ClearIntersected();
 	bool res = GetIntersectionTargetList_NoVector(shotData);
 	if (res) {
+		bool bEraseShot = IsEraseShot();
 		for (auto& iTarget : listIntersectionTarget_) {
 			if (iTarget.first && iTarget.second != nullptr)
-				intersectionManager->AddTarget(iTarget.second);
+				intersectionManager->AddTarget(iTarget.second.get(), bEraseShot);
 		}
 	}
 }
 StgIntersectionObject::IntersectionListType StgNormalShotObject::GetIntersectionTargetList() {
-	if ((IsDeleted() || delay_.time > 0 || frameFadeDelete_ >= 0)
-		|| (bUserIntersectionMode_ || !bIntersectionEnable_)
-		|| pOwnReference_.expired())
+	if (IsDeleted() || !IsIntersectionActive() || pOwnReference_.expired())
 		return IntersectionListType();
 
 	StgShotData* shotData = _GetShotData();
@@ -1913,9 +2094,10 @@ void StgLaserObject::_AddIntersectionRelativeTarget() {
 
 	bool res = GetIntersectionTargetList_NoVector(shotData);
 	if (res) {
+		bool bEraseShot = IsEraseShot();
 		for (auto& iTarget : listIntersectionTarget_) {
 			if (iTarget.first && iTarget.second != nullptr)
-				intersectionManager->AddTarget(iTarget.second);
+				intersectionManager->AddTarget(iTarget.second.get(), bEraseShot);
 		}
 	}
 }
@@ -10,6 +10,42 @@ class StgShotData;
 struct StgShotDataFrame;
 class StgShotVertexBufferContainer;
 class StgShotObject;
+class StgNormalShotObject;
+class StgEnemyObject;
+
+struct StgEnemyHitCooldownHasher {
+	std::size_t operator()(const ref_unsync_weak_ptr<StgEnemyObject>& k) const {
+		return std::hash<StgEnemyObject*>{}(k.get());
+	}
+};
+//Frames left before a shot can hit each enemy again
+using StgEnemyHitCooldownMap = std::unordered_map<ref_unsync_weak_ptr<StgEnemyObject>, uint32_t, StgEnemyHitCooldownHasher>;
+
+//*******************************************************************
+//StgShotCoreStore
+//	Shot handles in creation order, with a column of state flags refreshed once per frame
+//	Only the flags the manager's passes filter on are copied, positions and the rest stay on the objects
+//*******************************************************************
+class StgShotCoreStore {
+public:
+	enum : uint8_t {
+		FLAG_ACTIVE = 1 << 0,
+		FLAG_DELETED = 1 << 1,
+		FLAG_INTERSECTION = 1 << 2,		//Worth calling RegistIntersectionTarget on
+		FLAG_OWNER_PLAYER = 1 << 3,
+	};
+public:
+	std::vector<ref_unsync_ptr<StgShotObject>> listObject;
+	std::vector<uint8_t> listFlag;
+
+	size_t GetSize() const { return listObject.size(); }
+
+	void Add(ref_unsync_ptr<StgShotObject> obj);
+	void Sync(size_t index);
+	//Removes every entry for which pred(index) returns true, the order of the rest is kept
+	template<class F> void RemoveIf(F&& pred);
+};
+
 //*******************************************************************
 //StgShotManager
 //*******************************************************************
@@ -40,6 +76,12 @@ public:
 
 		BLEND_COUNT = 8,
 	};
+	enum : uint8_t {
+		POOL_SHOT,
+		POOL_PATTERN_ANGLE,
+		POOL_PATTERN_XY,
+		POOL_TARGET_CIRCLE,
+	};
 protected:
 	static std::array<BlendMode, BLEND_COUNT> blendTypeRenderOrder;
 	struct RenderQueue {
@@ -47,12 +89,16 @@ protected:
 		std::vector<StgShotObject*> listShot;
 	};
 protected:
+	static StgShotManager* active_;
+
 	StgStageController* stageController_;
 
 	unique_ptr<StgShotDataList> listPlayerShotData_;
 	unique_ptr<StgShotDataList> listEnemyShotData_;
 
-	std::list<ref_unsync_ptr<StgShotObject>> listObj_;
+	StgShotCoreStore store_;
+	bool bParallelWork_;
+	std::vector<StgNormalShotObject*> listParallelWork_;
 	std::vector<RenderQueue> listRenderQueuePlayer_;		//one for each render pri
 	std::vector<RenderQueue> listRenderQueueEnemy_;			//one for each render pri
 
@@ -65,12 +111,38 @@ protected:
 
 	ID3DXEffect* effectShot_;
 	D3DXMATRIX matProj_;
+
+	//Recycled memory for the objects created and freed the most
+	StgObjectPool poolShot_;
+	StgObjectPool poolPatternAngle_;
+	StgObjectPool poolPatternXY_;
+	StgObjectPool poolTargetCircle_;
+
+	//Containers left by freed shots, emptied but kept allocated for the next shots
+	std::vector<StgIntersectionObject::IntersectionListType> listSpareIntersection_;
+	std::vector<unique_ptr<StgEnemyHitCooldownMap>> listSpareHitCooldown_;
 public:
 	IDirect3DTexture9* pLastTexture_;
 public:
 	StgShotManager(StgStageController* stageController);
 	virtual ~StgShotManager();
 
+	//Pooled allocations are served by the most recently built manager, or by the heap while there is none.
+	//	Blocks of one type all have the same size, so any manager's pool can take them back.
+	//	Main thread only. Isolated script groups rely on shot creation not being a thread-safe native,
+	//	so ScriptIsolationGate always runs it on the main thread.
+	static void* AllocatePooled(int type, size_t size);
+	static void ReleasePooled(int type, void* ptr, size_t size);
+	static StgShotManager* GetActive() { return active_; }
+	StgObjectPool* GetPool(int type);
+
+	//New shots take the containers of freed ones instead of building their own
+	void TakeSpareIntersectionList(StgIntersectionObject::IntersectionListType& list);
+	void ReturnSpareIntersectionList(StgIntersectionObject::IntersectionListType& list);
+	unique_ptr<StgEnemyHitCooldownMap> TakeSpareHitCooldownMap();
+	void ReturnSpareHitCooldownMap(unique_ptr<StgEnemyHitCooldownMap>& map);
+
+	void WorkParallel();
 	void Work();
 	void Render(int targetPriority);
 	void LoadRenderQueue();
@@ -91,6 +163,11 @@ public:
 	void SetShotDeleteClip(const DxRect<LONG>& clip) { rcDeleteClip_ = clip; }
 	DxRect<LONG>* GetShotDeleteClip() { return &rcDeleteClip_; }
 
+	//Shots done in WorkParallel move before every other object's Work in the frame,
+	//	so event scripts run from that Work (item/player delete events, boss steps) see them already moved
+	void SetParallelWorkEnable(bool b) { bParallelWork_ = b; }
+	bool IsParallelWorkEnable() { return bParallelWork_; }
+
 	void SetTextureFilter(D3DTEXTUREFILTERTYPE min, D3DTEXTUREFILTERTYPE mag) {
 		filterMin_ = min;
 		filterMag_ = mag;
@@ -102,7 +179,7 @@ public:
 	std::vector<int> GetShotIdInRegularPolygon(int typeOwner, int cx, int cy, int* radius, int edges, double angle);
 	std::vector<int> GetLaserIdAll(int typeOwner);
 	size_t GetShotCount(int typeOwner);
-	size_t GetShotCountAll() { return listObj_.size(); }
+	size_t GetShotCountAll() { return store_.GetSize(); }
 
 	void SetDeleteEventEnableByType(int type, bool bEnable);
 	bool IsDeleteEventEnable(TypeDelete bit) { return listDeleteEventEnable_[(int)bit]; }
@@ -316,15 +393,9 @@ protected:
 	bool bPenetrateShot_; // Translation: Does The Shot Lose Penetration Points Upon Colliding With Another Shot And Not An Enemy
 
 	weak_ptr<Texture> renderTarget_;
-private:
-	struct _WeakPtrHasher {
-		std::size_t operator()(const ref_unsync_weak_ptr<StgEnemyObject>& k) const {
-			return std::hash<StgEnemyObject*>{}(k.get());
-		}
-	};
 public:
 	uint32_t frameEnemyHitInvalid_;
-	std::unordered_map<ref_unsync_weak_ptr<StgEnemyObject>, uint32_t, _WeakPtrHasher> mapEnemyHitCooldown_;
+	unique_ptr<StgEnemyHitCooldownMap> mapEnemyHitCooldown_;	//Created on the first cooldown
 	
 	bool bRequestedPlayerDeleteEvent_;
 	double damage_;
@@ -345,6 +416,8 @@ public:
 	bool bEnableMotionDelay_;
 	bool bRoundingPosition_;
 	double roundingAngle_;
+
+	bool bWorkAhead_;		//This frame's non-deleting work was already done by StgShotManager::WorkParallel
 public:
 	StgShotData* _GetShotData() { return _GetShotData(idShotData_); }
 	inline StgShotData* _GetShotData(int id);
@@ -358,6 +431,9 @@ protected:
 	virtual void _DeleteInFadeDelete();
 	void _DeleteInAutoDeleteFrame();
 	void _CommonWorkTask();
+	void _CommonWorkCounter();
+	void _CommonWorkDelete();
+	StgEnemyHitCooldownMap* _GetEnemyHitCooldownMap();
 
 	virtual void _Move();
 
@@ -371,6 +447,7 @@ protected:
 	int timerTransformNext_;
 
 	void _ProcessTransformAct();
+	bool _IsTransformActDue();
 public:
 	StgShotObject(StgStageController* stageController);
 	virtual ~StgShotObject();
@@ -456,6 +533,10 @@ public:
 	void SetUserIntersectionMode(bool b) { bUserIntersectionMode_ = b; }
 	void SetIntersectionEnable(bool b) { bIntersectionEnable_ = b; }
 	bool IsIntersectionEnable() { return bIntersectionEnable_; }
+	//Whether the shot's own collision is in effect this frame, regardless of deletion
+	bool IsIntersectionActive() {
+		return delay_.time <= 0 && frameFadeDelete_ < 0 && !bUserIntersectionMode_ && bIntersectionEnable_;
+	}
 	void SetItemChangeEnable(bool b) { bChangeItemEnable_ = b; }
 
 	void SetPositionRounding(bool b) { bRoundingPosition_ = b; }
@@ -479,15 +560,38 @@ protected:
 
 	void _AddIntersectionRelativeTarget();
 	virtual void _SendDeleteEvent(TypeDelete type);
+
+	void _WorkMotion();
 public:
 	StgNormalShotObject(StgStageController* stageController);
 	virtual ~StgNormalShotObject();
 
+	static void* operator new(size_t size) {
+		return StgShotManager::AllocatePooled(StgShotManager::POOL_SHOT, size);
+	}
+	static void operator delete(void* ptr, size_t size) {
+		StgShotManager::ReleasePooled(StgShotManager::POOL_SHOT, ptr, size);
+	}
+
 	virtual void Clone(DxScriptObjectBase* src);
 
 	virtual void Work();
 	virtual void Render(BlendMode targetBlend);
 
+	//Whether everything but deletion in this frame's Work only reads and writes this object
+	bool IsWorkIsolated() {
+		if (IsDeleted() || !IsActive()) return false;
+		bool bCooldown = mapEnemyHitCooldown_ != nullptr && !mapEnemyHitCooldown_->empty();
+		return !bCooldown && !_IsTransformActDue() && _IsMoveIsolated();
+	}
+	//Marks this shot for WorkAhead
+	bool ReserveWorkAhead() {
+		if (bWorkAhead_ || !IsWorkIsolated()) return false;
+		bWorkAhead_ = true;
+		return true;
+	}
+	void WorkAhead();
+
 	virtual void ClearShotObject() {
 		ClearIntersectionRelativeTarget();
 	}
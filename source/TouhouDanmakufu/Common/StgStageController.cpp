@@ -354,6 +354,7 @@ void StgStageController::Work() {
 
 			//Skip all this if the stage has already ended
 			if (infoStage_->IsEnd()) return;
+			shotManager_->WorkParallel();
 			objectManagerMain_->WorkObject();
 
 			enemyManager_->Work();
@@ -391,6 +392,18 @@ void StgStageController::Work() {
 		logger->SetInfo(6, L"Shot count", StringUtility::Format(L"%d", shotManager_->GetShotCountAll()));
 		logger->SetInfo(7, L"Enemy count", StringUtility::Format(L"%d", enemyManager_->GetEnemyCount()));
 		logger->SetInfo(8, L"Item count", StringUtility::Format(L"%d", itemManager_->GetItemCount()));
+		{
+			StgObjectPool* poolShot = shotManager_->GetPool(StgShotManager::POOL_SHOT);
+			StgObjectPool* poolAngle = shotManager_->GetPool(StgShotManager::POOL_PATTERN_ANGLE);
+			StgObjectPool* poolXY = shotManager_->GetPool(StgShotManager::POOL_PATTERN_XY);
+			StgObjectPool* poolTarget = shotManager_->GetPool(StgShotManager::POOL_TARGET_CIRCLE);
+			logger->SetInfo(12, L"Shot pool (hit/miss)",
+				StringUtility::Format(L"Shot=%llu/%llu, Pattern=%llu/%llu, Target=%llu/%llu",
+					poolShot->GetHitCount(), poolShot->GetMissCount(),
+					poolAngle->GetHitCount() + poolXY->GetHitCount(),
+					poolAngle->GetMissCount() + poolXY->GetMissCount(),
+					poolTarget->GetHitCount(), poolTarget->GetMissCount()));
+		}
 	}
 }
 void StgStageController::Render() {
@@ -339,6 +339,7 @@ static const std::vector<function> stgStageFunction = {
 	{ "GetShotDataInfoA1", StgStageScript::Func_GetShotDataInfoA1, 3 },
 	{ "SetShotDeleteEventEnable", StgStageScript::Func_SetShotDeleteEventEnable, 2 },
 	{ "SetShotTextureFilter", StgStageScript::Func_SetShotTextureFilter, 2 },
+	{ "SetShotParallelWorkEnable", StgStageScript::Func_SetShotParallelWorkEnable, 1 },
 
 	//STG共通関数：アイテム
 	{ "CreateItemA1", StgStageScript::Func_CreateItemA1, 4 },
@@ -2376,6 +2377,15 @@ gstd::value StgStageScript::Func_SetShotDeleteEventEnable(gstd::script_machine*
 
 	return value();
 }
+gstd::value StgStageScript::Func_SetShotParallelWorkEnable(gstd::script_machine* machine, int argc, const gstd::value* argv) {
+	StgStageScript* script = (StgStageScript*)machine->data;
+	StgStageController* stageController = script->stageController_;
+	StgShotManager* shotManager = stageController->GetShotManager();
+
+	shotManager->SetParallelWorkEnable(argv[0].as_boolean());
+
+	return value();
+}
 gstd::value StgStageScript::Func_SetShotTextureFilter(gstd::script_machine* machine, int argc, const gstd::value* argv) {
 	StgStageScript* script = (StgStageScript*)machine->data;
 	StgStageController* stageController = script->stageController_;
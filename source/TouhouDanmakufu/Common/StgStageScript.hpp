@@ -287,6 +287,7 @@ public:
 	static gstd::value Func_GetShotDataInfoA1(gstd::script_machine* machine, int argc, const gstd::value* argv);
 	DNH_FUNCAPI_DECL_(Func_SetShotDeleteEventEnable);
 	DNH_FUNCAPI_DECL_(Func_SetShotTextureFilter);
+	DNH_FUNCAPI_DECL_(Func_SetShotParallelWorkEnable);
 
 	//STG共通関数：アイテム
 	static gstd::value Func_CreateItemA1(gstd::script_machine* machine, int argc, const gstd::value* argv);
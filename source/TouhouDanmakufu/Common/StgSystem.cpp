@@ -52,6 +52,7 @@ void StgSystemController::Initialize(ref_count_ptr<StgSystemInformation> infoSys
 	infoSystem_ = infoSystem;
 
 	scriptEngineCache_.reset(new ScriptEngineCache());
+	scriptEngineCache_->SetBytecodeDirectory(EPathProperty::GetScriptCacheDirectory());
 	commonDataManager_.reset(new ScriptCommonDataManager());
 	infoControlScript_ = new StgControlScriptInformation();
 }
@@ -100,11 +100,10 @@ shared_ptr<ManagedScript> StgUserExtendSceneScriptManager::Create(int type) {
 	return res;
 }
 void StgUserExtendSceneScriptManager::CallScriptFinalizeAll() {
-	std::map<std::string, script_block*>::iterator itrEvent;
 	for (auto itr = listScriptRun_.begin(); itr != listScriptRun_.end(); itr++) {
 		shared_ptr<ManagedScript> script = (*itr);
-		if (script->IsEventExists("Finalize", itrEvent))
-			script->Run(itrEvent);
+		if (script_block* pEvent = script->GetEvent(script_engine::EVENT_FINALIZE))
+			script->Run(pEvent);
 	}
 }
 gstd::value StgUserExtendSceneScriptManager::GetResultValue() {
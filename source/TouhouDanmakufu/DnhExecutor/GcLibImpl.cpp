@@ -24,8 +24,13 @@ bool EApplication::_Initialize() {
 	EFileManager* fileManager = EFileManager::CreateInstance();
 	fileManager->Initialize();
 
+	threadPool_.reset(new ThreadPool());
+
 	EFpsController* fpsController = EFpsController::CreateInstance();
 	fpsController->SetFastModeRate((size_t)config->fastModeSpeed_ * 60U);
+
+	ScriptManager::SetDefaultInstructionBudget(config->scriptInstructionBudget_, 
+		config->bScriptInstructionBudgetYield_);
 	
 	std::wstring appName = L"";
 
@@ -184,6 +189,9 @@ bool EApplication::_Loop() {
 
 				logger->SetInfo(2, L"Font cache",
 					StringUtility::Format(L"%d", EDxTextRenderer::GetInstance()->GetCacheCount()));
+				logger->SetInfo(3, L"Thread pool",
+					StringUtility::Format(L"Workers=%u, Tasks=%llu, Steals=%llu", (uint32_t)threadPool_->GetWorkerCount(),
+						threadPool_->GetTaskRunCount(), threadPool_->GetStealCount()));
 			}
 
 			if (count % 120 == 0) {
@@ -383,6 +391,7 @@ bool EApplication::_Finalize() {
 	EDirectGraphics::DeleteInstance();
 	EFpsController::DeleteInstance();
 	EFileManager::DeleteInstance();
+	threadPool_ = nullptr;
 
 	ELogger* logger = ELogger::GetInstance();
 	logger->SaveState();
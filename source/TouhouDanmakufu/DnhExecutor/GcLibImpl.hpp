@@ -15,6 +15,7 @@ class EApplication : public Singleton<EApplication>, public Application {
 	friend Singleton<EApplication>;
 protected:
 	EDirectGraphics* ptrGraphics;
+	unique_ptr<ThreadPool> threadPool_;
 
 	bool bWindowFocused_;
 